@@ -1,18 +1,137 @@
 #include "bmp_utils.h"
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
-int width, height;
-unsigned char header[54];
+static unsigned get_le16(const unsigned char *p) {
+    return p[0] | p[1] << 8;
+}
+
+static unsigned get_le32(const unsigned char *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (unsigned)p[3] << 24;
+}
+
+static void put_le32(unsigned char *p, unsigned v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void put_le16(unsigned char *p, unsigned v) {
+    p[0] = v; p[1] = v >> 8;
+}
 
-void readHeader(FILE *in) {
-    if (fread(header, sizeof(header), 1, in) != 1) {
+int readHeader(FILE *in, BmpInfo *info) {
+    // Leemos también las máscaras de BI_BITFIELDS, que siguen a los 54 bytes
+    unsigned char h[BMP_HEADER_SIZE + 12];
+    size_t n = fread(h, 1, sizeof(h), in);
+    if (n < BMP_HEADER_SIZE) {
         fprintf(stderr, "[ERROR] Lectura de cabecera fallida\n");
-        exit(EXIT_FAILURE);
+        return -1;
+    }
+    if (h[0] != 'B' || h[1] != 'M') {
+        fprintf(stderr, "[ERROR] No es un BMP (firma distinta de BM)\n");
+        return -1;
+    }
+
+    unsigned offset = get_le32(&h[10]);
+    unsigned info_size = get_le32(&h[14]);
+    int width = (int)get_le32(&h[18]);
+    int height = (int)get_le32(&h[22]);
+    unsigned planes = get_le16(&h[26]);
+    unsigned bpp = get_le16(&h[28]);
+    unsigned compression = get_le32(&h[30]);
+
+    if (info_size < 40 || planes != 1) {
+        fprintf(stderr, "[ERROR] Cabecera BMP no soportada (biSize=%u, planos=%u)\n", info_size, planes);
+        return -1;
+    }
+    if (bpp != 24 && bpp != 32) {
+        fprintf(stderr, "[ERROR] BMP de %u bits no soportado (sólo 24 o 32)\n", bpp);
+        return -1;
+    }
+    if (compression == 3 && bpp == 32) {
+        // BI_BITFIELDS: sólo el orden habitual B, G, R, (A)
+        if (n < sizeof(h) || get_le32(&h[54]) != 0x00FF0000u ||
+            get_le32(&h[58]) != 0x0000FF00u || get_le32(&h[62]) != 0x000000FFu) {
+            fprintf(stderr, "[ERROR] BMP con máscaras de color no soportadas\n");
+            return -1;
+        }
+    } else if (compression != 0) {
+        fprintf(stderr, "[ERROR] BMP comprimido no soportado (biCompression=%u)\n", compression);
+        return -1;
+    }
+    if (width <= 0 || height == 0 || height == (int)0x80000000 ||
+        (long long)width * (height < 0 ? -height : height) > (1LL << 30)) {
+        fprintf(stderr, "[ERROR] Dimensiones BMP inválidas (%d x %d)\n", width, height);
+        return -1;
     }
-    width = *(int *)&header[18];
-    height = *(int *)&header[22];
+    if (offset < 14 + info_size) {
+        fprintf(stderr, "[ERROR] Desplazamiento de píxeles inválido (%u)\n", offset);
+        return -1;
+    }
+
+    // Los píxeles deben caber en el archivo: uno truncado se rechaza aquí
+    // y no a mitad de la corrida
+    size_t stride = ((size_t)width * bpp / 8 + 3) & ~(size_t)3;
+    long long needed = (long long)offset + (long long)stride * (height < 0 ? -height : height);
+    struct stat st;
+    long long file_size = fstat(fileno(in), &st) == 0 ? (long long)st.st_size : -1;
+    if (file_size < needed) {
+        fprintf(stderr, "[ERROR] BMP truncado (%lld bytes, se esperaban %lld)\n",
+                file_size, needed);
+        return -1;
+    }
+
+    info->width = width;
+    info->height = height < 0 ? -height : height;
+    info->top_down = height < 0;
+    info->bpp = (int)bpp;
+    info->offset = offset;
+    info->stride = stride;
+
+    // Cabecera de salida: 24 bits, de abajo hacia arriba, sin compresión
+    size_t out_stride = ((size_t)width * 3 + 3) & ~(size_t)3;
+    memcpy(info->header, h, BMP_HEADER_SIZE);
+    put_le32(&info->header[2], (unsigned)(BMP_HEADER_SIZE + out_stride * info->height));  // bfSize
+    put_le32(&info->header[10], BMP_HEADER_SIZE);                                           // bfOffBits
+    put_le32(&info->header[14], 40);                                                        // biSize
+    put_le32(&info->header[22], (unsigned)info->height);                                    // biHeight
+    put_le16(&info->header[28], 24);                                                        // biBitCount
+    put_le32(&info->header[30], 0);                                                         // biCompression
+    put_le32(&info->header[34], (unsigned)(out_stride * info->height));                     // biSizeImage
+    return 0;
+}
+
+int readPixels(FILE *in, const BmpInfo *info, Pixel *dst) {
+    size_t npix = (size_t)info->width * info->height;
+    if (fseek(in, info->offset, SEEK_SET) != 0) return -1;
+
+    // Caso común: 24 bits, sin relleno, de abajo hacia arriba. Lectura en
+    // bloque: Pixel tiene el mismo orden B, G, R del archivo
+    if (info->bpp == 24 && info->stride == (size_t)info->width * 3 && !info->top_down) {
+        return fread(dst, sizeof(Pixel), npix, in) == npix ? 0 : -1;
+    }
+
+    unsigned char *row = malloc(info->stride);
+    if (!row) return -1;
+    int bytes = info->bpp / 8;
+    for (int y = 0; y < info->height; y++) {
+        if (fread(row, 1, info->stride, in) != info->stride) {
+            free(row);
+            return -1;
+        }
+        int dst_y = info->top_down ? info->height - 1 - y : y;
+        Pixel *out = &dst[(size_t)dst_y * info->width];
+        for (int x = 0; x < info->width; x++) {
+            const unsigned char *p = &row[(size_t)x * bytes];
+            out[x].b = p[0];
+            out[x].g = p[1];
+            out[x].r = p[2];
+        }
+    }
+    free(row);
+    return 0;
 }
 
 void createFolder(const char *path) {
@@ -25,16 +144,13 @@ void createFolder(const char *path) {
     }
 }
 
-void writeBMP(int img, const char *suffix, Pixel *buf, int kernel_size) {
-    char oname[128];
-    snprintf(oname, sizeof(oname), "salidas/%06d_%s_%d.bmp", img, suffix, kernel_size);
-    FILE *fout = fopen(oname, "wb");
-    if (!fout) {
-        fprintf(stderr, "[ERROR] No se puede crear '%s'\n", oname);
-        return;
-    }
-    fwrite(header, sizeof(header), 1, fout);
-    size_t npix = (size_t)width * height;
-    fwrite(buf, sizeof(Pixel), npix, fout);
-    fclose(fout);
+// El nombre es único aunque varios hilos o workers escriban el mismo path
+FILE *createTempFile(const char *path, char *tmp, size_t size) {
+    snprintf(tmp, size, "%s.tmp.XXXXXX", path);
+    int fd = mkstemp(tmp);
+    if (fd < 0) return NULL;
+    fchmod(fd, 0644);  // mkstemp crea con 0600; las salidas se comparten
+    FILE *out = fdopen(fd, "wb");
+    if (!out) { close(fd); unlink(tmp); }
+    return out;
 }
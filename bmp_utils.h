@@ -2,17 +2,35 @@
 #define BMP_UTILS_H
 
 #include <stdio.h>
+#include <stddef.h>
 
 // Estructura RGB
 typedef struct { unsigned char b, g, r; } Pixel;
 
-// Variables globales accesibles
-extern int width, height;
-extern unsigned char header[54];
+#define BMP_HEADER_SIZE 54
+
+// Cabecera y dimensiones de una imagen BMP (una por imagen, no globales).
+// Se aceptan BMP sin compresión de 24 o 32 bits (32 bits también con
+// BI_BITFIELDS en orden BGRA), con filas alineadas a 4 bytes y de abajo
+// hacia arriba o de arriba hacia abajo (alto negativo).
+typedef struct {
+    int width, height;         // height siempre positivo
+    int bpp;                   // 24 o 32 bits por píxel en el archivo
+    int top_down;              // la primera fila del archivo es la de arriba
+    unsigned offset;           // inicio de los píxeles en el archivo
+    size_t stride;             // bytes por fila en el archivo, con relleno
+    // Cabecera de las salidas: la de entrada normalizada a 24 bits, de
+    // abajo hacia arriba y con los píxeles justo después
+    unsigned char header[BMP_HEADER_SIZE];
+} BmpInfo;
 
 // Funciones BMP
-void readHeader(FILE *in);
-void writeBMP(int img, const char *suffix, Pixel *buf, int kernel_size);
+int readHeader(FILE *in, BmpInfo *info);   // 0 si es válida, -1 (con mensaje) si no
+// Lee los píxeles de abajo hacia arriba, sin relleno ni alfa; 0 si pudo
+int readPixels(FILE *in, const BmpInfo *info, Pixel *dst);
 void createFolder(const char *path);
+// Crea y abre para escritura <path>.tmp.XXXXXX (nombre único, mkstemp) en
+// el mismo directorio, para luego publicarlo con rename; NULL si falla
+FILE *createTempFile(const char *path, char *tmp, size_t size);
 
 #endif
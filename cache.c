@@ -0,0 +1,259 @@
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+// --- XXH64 (https://github.com/Cyan4973/xxHash) ---------------------------
+
+static const uint64_t P1 = 11400714785074694791ULL;
+static const uint64_t P2 = 14029467366897019727ULL;
+static const uint64_t P3 = 1609587929392839161ULL;
+static const uint64_t P4 = 9650029242287828579ULL;
+static const uint64_t P5 = 2870177450012600261ULL;
+
+static uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+static uint64_t read64(const unsigned char *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static uint32_t read32(const unsigned char *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * P2;
+    acc = rotl64(acc, 31);
+    return acc * P1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * P1 + P4;
+}
+
+uint64_t hashPixels(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+        const unsigned char *limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = seed + P5;
+    }
+    h += len;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl64(h, 27) * P1 + P4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32(p) * P1;
+        h = rotl64(h, 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * P5;
+        h = rotl64(h, 11) * P1;
+    }
+
+    h ^= h >> 33; h *= P2;
+    h ^= h >> 29; h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+// --- Caché en disco --------------------------------------------------------
+
+void cacheInit(ResultCache *c, const char *dir, long max_mb) {
+    c->dir = dir;
+    c->max_bytes = (long long)max_mb * 1000000;
+    c->inserted = 0;
+    if (dir) createFolder(dir);
+}
+
+void cacheKey(char *path, size_t len, const ResultCache *c, uint64_t hash,
+              int w, int h, const char *suffix, int kernel, const Encoder *enc) {
+    if (kernel > 0) {
+        snprintf(path, len, "%s/%016llx_%dx%d_%s_%d.%s", c->dir,
+                 (unsigned long long)hash, w, h, suffix, kernel, enc->name);
+    } else {
+        snprintf(path, len, "%s/%016llx_%dx%d_%s.%s", c->dir,
+                 (unsigned long long)hash, w, h, suffix, enc->name);
+    }
+}
+
+int cacheHas(const char *path) {
+    return access(path, F_OK) == 0;
+}
+
+// La fecha de modificación hace de "último uso" para el recorte LRU
+static void touch(const char *path) {
+    utimes(path, NULL);
+}
+
+// Copia src en out y cierra out (también si src no se puede abrir)
+static int copyToStream(const char *src, FILE *out) {
+    FILE *in = fopen(src, "rb");
+    if (!in) { fclose(out); return 0; }
+
+    unsigned char buf[1 << 16];
+    size_t n;
+    int ok = 1;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) { ok = 0; break; }
+    }
+    fclose(in);
+    if (fclose(out) != 0) ok = 0;
+    return ok;
+}
+
+int cacheFetch(const char *path, const char *out_name) {
+    char oname[160];
+    snprintf(oname, sizeof(oname), "salidas/%s", out_name);
+    unlink(oname);
+    if (link(path, oname) != 0) {
+        // Sin hardlink (otro sistema de archivos): copia aparte y rename
+        char tmp[200];
+        FILE *out = createTempFile(oname, tmp, sizeof(tmp));
+        if (!out) return 0;
+        if (!copyToStream(path, out) || rename(tmp, oname) != 0) {
+            unlink(tmp);
+            return 0;
+        }
+    }
+    touch(path);
+    return 1;
+}
+
+unsigned char *cacheRead(const char *path, size_t *len) {
+    FILE *in = fopen(path, "rb");
+    if (!in) return NULL;
+    struct stat st;
+    if (fstat(fileno(in), &st) != 0) { fclose(in); return NULL; }
+
+    unsigned char *data = malloc(st.st_size > 0 ? st.st_size : 1);
+    if (!data || fread(data, 1, st.st_size, in) != (size_t)st.st_size) {
+        free(data);
+        fclose(in);
+        return NULL;
+    }
+    fclose(in);
+    touch(path);
+    *len = st.st_size;
+    return data;
+}
+
+static void countInserted(ResultCache *c, const char *path) {
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        #pragma omp atomic
+        c->inserted += st.st_size;
+    }
+}
+
+void cacheStoreFile(ResultCache *c, const char *path, const char *out_name) {
+    char oname[160];
+    snprintf(oname, sizeof(oname), "salidas/%s", out_name);
+    // link es atómico; si otro proceso ya la guardó, la suya vale igual
+    if (link(oname, path) == 0) {
+        countInserted(c, path);
+        return;
+    }
+    if (cacheHas(path)) return;
+
+    char tmp[600];
+    FILE *out = createTempFile(path, tmp, sizeof(tmp));
+    if (!out) return;
+    if (copyToStream(oname, out) && rename(tmp, path) == 0) {
+        countInserted(c, path);
+    } else {
+        unlink(tmp);
+    }
+}
+
+void cacheStoreData(ResultCache *c, const char *path, const unsigned char *data, size_t len) {
+    if (cacheHas(path)) return;
+
+    // Escribimos aparte y renombramos: nadie debe ver una entrada a medias
+    char tmp[600];
+    FILE *out = createTempFile(path, tmp, sizeof(tmp));
+    if (!out) return;
+    int ok = fwrite(data, 1, len, out) == len;
+    if (fclose(out) != 0) ok = 0;
+    if (ok && rename(tmp, path) == 0) {
+        #pragma omp atomic
+        c->inserted += len;
+    } else {
+        unlink(tmp);
+    }
+}
+
+typedef struct {
+    char name[256];
+    long long size;
+    time_t mtime;
+} cache_entry_t;
+
+static int by_mtime(const void *a, const void *b) {
+    const cache_entry_t *x = a, *y = b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+void cacheTrim(ResultCache *c, int force) {
+    if (!c->dir || c->max_bytes <= 0) return;
+    if (!force && c->inserted < c->max_bytes / 16) return;
+    c->inserted = 0;
+
+    DIR *dir = opendir(c->dir);
+    if (!dir) return;
+
+    cache_entry_t *entries = NULL;
+    size_t n = 0, capacity = 0;
+    long long total = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' || strstr(entry->d_name, ".tmp.")) continue;
+        char path[600];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", c->dir, entry->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+        if (n == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            cache_entry_t *grown = realloc(entries, capacity * sizeof(cache_entry_t));
+            if (!grown) break;
+            entries = grown;
+        }
+        snprintf(entries[n].name, sizeof(entries[n].name), "%s", entry->d_name);
+        entries[n].size = st.st_size;
+        entries[n].mtime = st.st_mtime;
+        total += st.st_size;
+        n++;
+    }
+    closedir(dir);
+
+    // Dejamos margen (90 %) para no recortar en cada imagen
+    if (total > c->max_bytes) {
+        qsort(entries, n, sizeof(cache_entry_t), by_mtime);
+        long long target = c->max_bytes / 10 * 9;
+        for (size_t i = 0; i < n && total > target; i++) {
+            char path[600];
+            snprintf(path, sizeof(path), "%s/%s", c->dir, entries[i].name);
+            if (unlink(path) == 0) total -= entries[i].size;
+        }
+    }
+    free(entries);
+}
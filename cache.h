@@ -0,0 +1,48 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "encoders.h"
+
+// Caché de resultados direccionada por contenido: cada salida se guarda
+// como <dir>/<hash>_<w>x<h>_<sufijo>[_<kernel>].<codificador>, así una
+// imagen repetida (en el mismo lote o en otro) no se vuelve a procesar.
+typedef struct {
+    const char *dir;        // NULL = caché desactivada
+    long long max_bytes;    // límite de tamaño; se recortan las menos usadas
+    long long inserted;     // bytes agregados desde el último recorte
+} ResultCache;
+
+// Crea el directorio si hace falta; max_mb es el límite en megabytes
+void cacheInit(ResultCache *c, const char *dir, long max_mb);
+
+// XXH64 de un bloque de memoria (rápido, no criptográfico); seed permite
+// encadenar bloques: hashPixels(b, lb, hashPixels(a, la, 0))
+uint64_t hashPixels(const void *data, size_t len, uint64_t seed);
+
+// Ruta de la entrada para una salida; el kernel sólo afecta al blur (kernel > 0)
+void cacheKey(char *path, size_t len, const ResultCache *c, uint64_t hash,
+              int w, int h, const char *suffix, int kernel, const Encoder *enc);
+
+// ¿Existe la entrada? (no la marca como usada)
+int cacheHas(const char *path);
+
+// Lleva la entrada a salidas/<out_name> (hardlink, o copia si no se puede)
+// y la marca como usada. Devuelve 1 si lo logró.
+int cacheFetch(const char *path, const char *out_name);
+
+// Lee la entrada completa a memoria (malloc) y la marca como usada; NULL si falla
+unsigned char *cacheRead(const char *path, size_t *len);
+
+// Guarda salidas/<out_name> (ya escrita) como entrada de la caché
+void cacheStoreFile(ResultCache *c, const char *path, const char *out_name);
+
+// Guarda un contenido ya codificado como entrada de la caché
+void cacheStoreData(ResultCache *c, const char *path, const unsigned char *data, size_t len);
+
+// Si se agregó bastante desde el último recorte (o force), borra las
+// entradas usadas hace más tiempo hasta quedar bajo el límite
+void cacheTrim(ResultCache *c, int force);
+
+#endif
@@ -0,0 +1,204 @@
+#include "encoders.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Escribe enteros little/big endian en un buffer de bytes
+static void put_le16(unsigned char *p, unsigned v) { p[0] = v; p[1] = v >> 8; }
+static void put_le32(unsigned char *p, unsigned v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+static void put_be32(unsigned char *p, unsigned v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+const Pixel *viewRow(const ImageView *v, int y, Pixel *tmp) {
+    int width = v->info->width, height = v->info->height;
+    int src_y = v->flip_v ? height - 1 - y : y;
+    const Pixel *row = &v->base[(size_t)src_y * width];
+    if (!v->flip_h) return row;
+    for (int x = 0; x < width; x++) tmp[x] = row[width - 1 - x];
+    return tmp;
+}
+
+// BMP de 24 bits: cabecera de la entrada (normalizada) y los píxeles tal cual
+static size_t encode_bmp24(const ImageView *v, int gray, unsigned char **out) {
+    int width = v->info->width, height = v->info->height;
+    const unsigned char *header = v->info->header;
+    (void) gray;
+    size_t row_bytes = (size_t)width * sizeof(Pixel);
+    size_t stride = (row_bytes + 3) & ~(size_t)3;   // filas alineadas a 4 bytes
+    size_t len = BMP_HEADER_SIZE + stride * height;
+    unsigned char *o = calloc(len, 1);
+    Pixel *tmp = malloc(row_bytes);
+    if (!o || !tmp) { free(o); free(tmp); return 0; }
+    memcpy(o, header, BMP_HEADER_SIZE);
+    for (int y = 0; y < height; y++) {
+        memcpy(o + BMP_HEADER_SIZE + (size_t)y * stride, viewRow(v, y, tmp), row_bytes);
+    }
+    free(tmp);
+    *out = o;
+    return len;
+}
+
+// BMP de 8 bits con paleta de grises: un byte por píxel (filas alineadas a 4)
+static size_t encode_bmp8(const ImageView *v, int gray, unsigned char **out) {
+    int width = v->info->width, height = v->info->height;
+    const unsigned char *header = v->info->header;
+    if (!gray) return encode_bmp24(v, gray, out);
+
+    size_t stride = ((size_t)width + 3) & ~(size_t)3;
+    size_t offset = BMP_HEADER_SIZE + 256 * 4;
+    size_t len = offset + stride * height;
+    unsigned char *o = calloc(len, 1);
+    Pixel *tmp = malloc((size_t)width * sizeof(Pixel));
+    if (!o || !tmp) { free(o); free(tmp); return 0; }
+
+    // Partimos de la cabecera de entrada (resolución, etc.) y ajustamos campos
+    memcpy(o, header, BMP_HEADER_SIZE);
+    put_le32(&o[2], (unsigned)len);                  // bfSize
+    put_le32(&o[10], (unsigned)offset);              // bfOffBits
+    put_le32(&o[14], 40);                            // biSize
+    put_le16(&o[28], 8);                             // biBitCount
+    put_le32(&o[30], 0);                             // biCompression = BI_RGB
+    put_le32(&o[34], (unsigned)(stride * height));   // biSizeImage
+    put_le32(&o[46], 256);                           // biClrUsed
+    put_le32(&o[50], 0);                             // biClrImportant
+    for (int i = 0; i < 256; i++) {
+        unsigned char *e = &o[BMP_HEADER_SIZE + i * 4];
+        e[0] = e[1] = e[2] = (unsigned char)i;
+    }
+
+    for (int y = 0; y < height; y++) {
+        const Pixel *src = viewRow(v, y, tmp);
+        unsigned char *dst = &o[offset + (size_t)y * stride];
+        for (int x = 0; x < width; x++) dst[x] = src[x].g;
+    }
+    free(tmp);
+    *out = o;
+    return len;
+}
+
+// QOI (https://qoiformat.org): compresión sin pérdida de una sola pasada
+static size_t encode_qoi(const ImageView *v, int gray, unsigned char **out) {
+    int width = v->info->width, height = v->info->height;
+    (void) gray;
+    size_t npix = (size_t)width * height;
+    unsigned char *o = malloc(14 + npix * 4 + 8);
+    Pixel *tmp = malloc((size_t)width * sizeof(Pixel));
+    if (!o || !tmp) { free(o); free(tmp); return 0; }
+
+    memcpy(o, "qoif", 4);
+    put_be32(&o[4], (unsigned)width);
+    put_be32(&o[8], (unsigned)height);
+    o[12] = 3;   // canales RGB
+    o[13] = 0;   // sRGB
+    size_t p = 14;
+
+    // El índice inicia en RGBA (0,0,0,0): ninguna entrada es válida
+    // hasta guardarla, porque nuestros píxeles siempre tienen alfa 255
+    Pixel index[64];
+    unsigned char used[64];
+    memset(index, 0, sizeof(index));
+    memset(used, 0, sizeof(used));
+    Pixel prev = { 0, 0, 0 };
+    int run = 0;
+
+    // QOI guarda de arriba hacia abajo; el BMP está de abajo hacia arriba
+    for (int y = height - 1; y >= 0; y--) {
+        const Pixel *row = viewRow(v, y, tmp);
+        for (int x = 0; x < width; x++) {
+            Pixel px = row[x];
+            if (px.r == prev.r && px.g == prev.g && px.b == prev.b) {
+                if (++run == 62) { o[p++] = 0xc0 | (run - 1); run = 0; }
+                continue;
+            }
+            if (run > 0) { o[p++] = 0xc0 | (run - 1); run = 0; }
+
+            int h = (px.r * 3 + px.g * 5 + px.b * 7 + 255 * 11) % 64;
+            if (used[h] && index[h].r == px.r && index[h].g == px.g && index[h].b == px.b) {
+                o[p++] = (unsigned char)h;
+            } else {
+                index[h] = px;
+                used[h] = 1;
+                signed char dr = (signed char)(px.r - prev.r);
+                signed char dg = (signed char)(px.g - prev.g);
+                signed char db = (signed char)(px.b - prev.b);
+                signed char dr_dg = (signed char)(dr - dg);
+                signed char db_dg = (signed char)(db - dg);
+                if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+                    o[p++] = 0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+                } else if (dg > -33 && dg < 32 && dr_dg > -9 && dr_dg < 8 &&
+                           db_dg > -9 && db_dg < 8) {
+                    o[p++] = 0x80 | (dg + 32);
+                    o[p++] = (dr_dg + 8) << 4 | (db_dg + 8);
+                } else {
+                    o[p++] = 0xfe;
+                    o[p++] = px.r; o[p++] = px.g; o[p++] = px.b;
+                }
+            }
+            prev = px;
+        }
+    }
+    if (run > 0) o[p++] = 0xc0 | (run - 1);
+
+    static const unsigned char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    memcpy(&o[p], padding, sizeof(padding));
+    p += sizeof(padding);
+    free(tmp);
+    *out = o;
+    return p;
+}
+
+static const Encoder encoders[] = {
+    { "bmp",  "bmp", encode_bmp24 },
+    { "bmp8", "bmp", encode_bmp8  },
+    { "qoi",  "qoi", encode_qoi   },
+};
+
+const Encoder *getEncoder(const char *name) {
+    for (size_t i = 0; i < sizeof(encoders) / sizeof(encoders[0]); i++) {
+        if (strcmp(encoders[i].name, name) == 0) return &encoders[i];
+    }
+    return NULL;
+}
+
+void outputName(char *name, size_t len, const Encoder *enc, int img,
+                const char *suffix, int kernel_size) {
+    snprintf(name, len, "%06d_%s_%d.%s", img, suffix, kernel_size, enc->ext);
+}
+
+void writeEncoded(const char *name, const unsigned char *data, size_t len) {
+    char oname[160];
+    snprintf(oname, sizeof(oname), "salidas/%s", name);
+    // Escribimos aparte y renombramos: con copias especulativas otro worker
+    // puede escribir el mismo archivo, y nadie debe ver uno a medias. Así
+    // tampoco se trunca en sitio un hardlink a una entrada de la caché.
+    char tmp[200];
+    FILE *fout = createTempFile(oname, tmp, sizeof(tmp));
+    if (!fout) {
+        fprintf(stderr, "[ERROR] No se puede crear '%s'\n", oname);
+        return;
+    }
+    int ok = fwrite(data, 1, len, fout) == len;
+    if (fclose(fout) != 0) ok = 0;
+    if (!ok || rename(tmp, oname) != 0) {
+        fprintf(stderr, "[ERROR] No se pudo escribir '%s'\n", oname);
+        unlink(tmp);
+    }
+}
+
+void writeImage(const Encoder *enc, int img, const char *suffix,
+                const ImageView *v, int gray, int kernel_size) {
+    unsigned char *data = NULL;
+    size_t len = enc->encode(v, gray, &data);
+    if (len == 0) {
+        fprintf(stderr, "[ERROR] No se pudo codificar %06d_%s\n", img, suffix);
+        return;
+    }
+
+    char name[128];
+    outputName(name, sizeof(name), enc, img, suffix, kernel_size);
+    writeEncoded(name, data, len);
+    free(data);
+}
@@ -0,0 +1,43 @@
+#ifndef ENCODERS_H
+#define ENCODERS_H
+
+#include <stddef.h>
+#include "bmp_utils.h"
+
+// Vista sobre un buffer (info->width x info->height): los espejos no se
+// materializan, el codificador invierte filas o píxeles al recorrer la imagen
+typedef struct {
+    const BmpInfo *info;
+    const Pixel *base;
+    int flip_h;   // espejo horizontal: píxeles invertidos dentro de cada fila
+    int flip_v;   // espejo vertical: orden de filas invertido
+} ImageView;
+
+// Devuelve la fila y de la vista; usa tmp (width píxeles) si hay flip_h
+const Pixel *viewRow(const ImageView *v, int y, Pixel *tmp);
+
+// Codificador de salida: genera en memoria el archivo completo
+typedef struct {
+    const char *name;   // nombre usado en la línea de comandos
+    const char *ext;    // extensión del archivo generado
+    // Codifica la vista; gray indica que r == g == b.
+    // Devuelve el tamaño en bytes y deja en *out un buffer de malloc.
+    size_t (*encode)(const ImageView *v, int gray, unsigned char **out);
+} Encoder;
+
+// Busca un codificador por nombre ("bmp", "bmp8", "qoi"); NULL si no existe
+const Encoder *getEncoder(const char *name);
+
+// Nombre del archivo de salida: <img>_<suffix>_<kernel>.<ext>
+void outputName(char *name, size_t len, const Encoder *enc, int img,
+                const char *suffix, int kernel_size);
+
+// Escribe un archivo ya codificado en salidas/<name> con un solo fwrite a un
+// temporal que luego se renombra: nunca queda una salida a medias
+void writeEncoded(const char *name, const unsigned char *data, size_t len);
+
+// Codifica y escribe salidas/<img>_<suffix>_<kernel>.<ext>
+void writeImage(const Encoder *enc, int img, const char *suffix,
+                const ImageView *v, int gray, int kernel_size);
+
+#endif
@@ -0,0 +1,588 @@
+#include "engine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+
+// Una salida por imagen: sufijo, vista a escribir y si es de escala de grises
+typedef struct {
+    const char *suffix;
+    ImageView view;
+    int gray;
+} output_t;
+
+// En todas las etapas, par = 0 hace que el hilo que llama trabaje solo
+// (imágenes chicas procesadas varias a la vez, una por hilo)
+
+// Pesos de luminancia en punto fijo: 0.21, 0.72 y 0.07 por 2^GRAY_SHIFT
+#define GRAY_SHIFT 16
+#define GRAY_WR    13763
+#define GRAY_WG    47186
+#define GRAY_WB    4588
+
+// Escala de grises por luminancia ponderada, copiada a los tres canales.
+// fixed elige la versión entera (difiere de la de float en a lo más
+// GRAY_FIXED_TOLERANCE niveles en unos pocos colores).
+static void grayscale(const Pixel *src, Pixel *dst, size_t npix, int par, int fixed) {
+    if (fixed) {
+        #pragma omp parallel for schedule(static) if(par)
+        for (size_t j = 0; j < npix; j++) {
+            unsigned lum = (GRAY_WR * src[j].r + GRAY_WG * src[j].g +
+                            GRAY_WB * src[j].b) >> GRAY_SHIFT;
+            dst[j].r = dst[j].g = dst[j].b = (unsigned char)lum;
+        }
+        return;
+    }
+    #pragma omp parallel for schedule(static) if(par)
+    for (size_t j = 0; j < npix; j++) {
+        unsigned char lum = (unsigned char)(
+            0.21f * src[j].r +
+            0.72f * src[j].g +
+            0.07f * src[j].b
+        );
+        dst[j].r = dst[j].g = dst[j].b = lum;
+    }
+}
+
+// División por recíproco: con m = ceil(2^32 / d), (n * m) >> 32 == n / d
+// para todo 0 <= n <= 255 * d siempre que 255 * d * d < 2^32, o sea
+// d < RECIP_MAX_DIV. Las sumas del blur cumplen n <= 255 * cnt.
+#define RECIP_MAX_DIV 4104
+
+// Tabla de recíprocos para divisores 1..max_d; NULL si alguno no sería
+// exacto (se divide normalmente)
+static uint64_t *reciprocals(int max_d) {
+    if (max_d >= RECIP_MAX_DIV) return NULL;
+    uint64_t *recip = malloc((size_t)(max_d + 1) * sizeof(uint64_t));
+    if (!recip) return NULL;
+    recip[0] = 0;
+    for (int d = 1; d <= max_d; d++) {
+        recip[d] = ((1ULL << 32) + d - 1) / d;
+    }
+    return recip;
+}
+
+static inline unsigned char average(int sum, int cnt, const uint64_t *recip) {
+    return recip ? (unsigned char)((sum * recip[cnt]) >> 32) : (unsigned char)(sum / cnt);
+}
+
+// Bloques de la pasada vertical: ancho en píxeles de un mosaico de columnas
+// (sus sumas caben en L1) y alto mínimo de una franja de filas
+#define BLUR_TILE_W   256
+#define BLUR_BAND_H   128
+
+// Blur de caja separable de kernel x kernel: horizontal a tmp, vertical a dst
+static void boxBlur(const Pixel *src, Pixel *tmp, Pixel *dst,
+                    int width, int height, int kernel, int par) {
+    int k = kernel / 2;
+    // El divisor (píxeles dentro de la ventana) nunca pasa de 2k+1 ni del lado mayor
+    int max_cnt = 2 * k + 1;
+    if (max_cnt > width && max_cnt > height) max_cnt = width > height ? width : height;
+    uint64_t *recip = reciprocals(max_cnt);
+    #pragma omp parallel for collapse(2) schedule(static) if(par)
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sr=0, sg=0, sb=0, cnt=0;
+            for (int d = -k; d <= k; d++) {
+                int xx = x + d;
+                if (xx >= 0 && xx < width) {
+                    const Pixel *p = &src[(size_t)y * width + xx];
+                    sr += p->r; sg += p->g; sb += p->b; cnt++;
+                }
+            }
+            tmp[(size_t)y * width + x].r = average(sr, cnt, recip);
+            tmp[(size_t)y * width + x].g = average(sg, cnt, recip);
+            tmp[(size_t)y * width + x].b = average(sb, cnt, recip);
+        }
+    }
+
+    // Pasada vertical por mosaicos: cada hilo lleva las sumas de un bloque
+    // de columnas y las desliza hacia abajo por una franja de filas, así
+    // sólo lee tramos contiguos de filas en lugar de un píxel por fila
+    int band_h = BLUR_BAND_H > 4 * kernel ? BLUR_BAND_H : 4 * kernel;
+    int n_tiles = (width + BLUR_TILE_W - 1) / BLUR_TILE_W;
+    int n_bands = (height + band_h - 1) / band_h;
+    #pragma omp parallel for collapse(2) schedule(dynamic, 1) if(par)
+    for (int band = 0; band < n_bands; band++) {
+        for (int tile = 0; tile < n_tiles; tile++) {
+            int x0 = tile * BLUR_TILE_W;
+            int tw = width - x0 < BLUR_TILE_W ? width - x0 : BLUR_TILE_W;
+            int y0 = band * band_h;
+            int y1 = y0 + band_h < height ? y0 + band_h : height;
+            int sum[BLUR_TILE_W][3];
+            memset(sum, 0, sizeof(sum));
+
+            // Ventana inicial: filas [y0 - k, y0 + k] dentro de la imagen
+            int lo = y0 - k > 0 ? y0 - k : 0;
+            int hi = y0 + k < height - 1 ? y0 + k : height - 1;
+            for (int yy = lo; yy <= hi; yy++) {
+                const Pixel *row = &tmp[(size_t)yy * width + x0];
+                for (int x = 0; x < tw; x++) {
+                    sum[x][0] += row[x].r; sum[x][1] += row[x].g; sum[x][2] += row[x].b;
+                }
+            }
+
+            for (int y = y0; y < y1; y++) {
+                int cnt = hi - lo + 1;
+                Pixel *out = &dst[(size_t)y * width + x0];
+                for (int x = 0; x < tw; x++) {
+                    out[x].r = average(sum[x][0], cnt, recip);
+                    out[x].g = average(sum[x][1], cnt, recip);
+                    out[x].b = average(sum[x][2], cnt, recip);
+                }
+                // Desplazamos la ventana una fila: entra y + k + 1, sale y - k
+                if (y + k + 1 < height) {
+                    const Pixel *row = &tmp[(size_t)(y + k + 1) * width + x0];
+                    for (int x = 0; x < tw; x++) {
+                        sum[x][0] += row[x].r; sum[x][1] += row[x].g; sum[x][2] += row[x].b;
+                    }
+                    hi++;
+                }
+                if (y - k >= 0) {
+                    const Pixel *row = &tmp[(size_t)(y - k) * width + x0];
+                    for (int x = 0; x < tw; x++) {
+                        sum[x][0] -= row[x].r; sum[x][1] -= row[x].g; sum[x][2] -= row[x].b;
+                    }
+                    lo++;
+                }
+            }
+        }
+    }
+    free(recip);
+}
+
+static void freeEncoded(EncodedOutputs *out) {
+    for (int o = 0; o < N_OUTPUTS; o++) {
+        free(out->data[o]);
+        out->data[o] = NULL;
+    }
+}
+
+// Entrega las salidas al sumidero, o las guarda en *deferred para que el
+// hilo que lanzó el lote las entregue en orden (el sumidero no es reentrante)
+static void deliver(const Engine *e, EncodedOutputs *out, EncodedOutputs *deferred) {
+    if (deferred) {
+        *deferred = *out;
+    } else {
+        e->sink(out, e->sink_arg);
+    }
+}
+
+// Intenta servir las seis salidas desde la caché; 1 si lo logró
+static int fromCache(const Engine *e, char paths[][600], const output_t *outputs, int img,
+                     EncodedOutputs *deferred) {
+    for (int o = 0; o < N_OUTPUTS; o++) {
+        if (!cacheHas(paths[o])) return 0;
+    }
+
+    if (!e->sink) {
+        for (int o = 0; o < N_OUTPUTS; o++) {
+            char name[128];
+            outputName(name, sizeof(name), e->encoder, img, outputs[o].suffix, e->kernel_size);
+            if (!cacheFetch(paths[o], name)) return 0;
+        }
+        return 1;
+    }
+
+    EncodedOutputs out;
+    memset(&out, 0, sizeof(out));
+    for (int o = 0; o < N_OUTPUTS; o++) {
+        outputName(out.names[o], sizeof(out.names[o]), e->encoder, img,
+                   outputs[o].suffix, e->kernel_size);
+        out.data[o] = cacheRead(paths[o], &out.len[o]);
+        if (!out.data[o]) {
+            freeEncoded(&out);
+            return 0;
+        }
+    }
+    deliver(e, &out, deferred);
+    return 1;
+}
+
+static int isCancelled(const Engine *e, int img) {
+    return e->cancelled && e->cancelled(img, e->cancel_arg);
+}
+
+// Procesa una imagen; par elige paralelismo dentro de la imagen. No recorta
+// la caché: puede correr en varios hilos a la vez.
+static int process(const Engine *e, const char *filename, int img, ImageStats *stats,
+                   int par, EncodedOutputs *deferred) {
+    ImageStats st;
+    memset(&st, 0, sizeof(st));
+    double t_start = omp_get_wtime();
+    if (isCancelled(e, img)) return 1;
+
+    FILE *fin = fopen(filename, "rb");
+    if (!fin) {
+        fprintf(stderr, "[ERROR] No se puede abrir %s\n", filename);
+        return -1;
+    }
+    BmpInfo info;
+    if (readHeader(fin, &info) != 0) {
+        fclose(fin);
+        return -1;
+    }
+    size_t npix = (size_t)info.width * info.height;
+    st.width = info.width;
+    st.height = info.height;
+
+    Pixel *buf_orig = malloc(npix * sizeof(Pixel));
+    Pixel *buf_gray = malloc(npix * sizeof(Pixel));
+    Pixel *buf_tmp  = malloc(npix * sizeof(Pixel));
+    Pixel *buf_blur = malloc(npix * sizeof(Pixel));
+    if (!buf_orig || !buf_gray || !buf_tmp || !buf_blur) {
+        fprintf(stderr, "[ERROR] malloc falló para %s\n", filename);
+        free(buf_orig); free(buf_gray); free(buf_tmp); free(buf_blur);
+        fclose(fin);
+        return -1;
+    }
+
+    // Respeta desplazamiento, relleno de filas, 32 bits y orientación
+    int rc = readPixels(fin, &info, buf_orig);
+    fclose(fin);
+    if (rc != 0) {
+        fprintf(stderr, "[ERROR] %s: no se pudieron leer los píxeles\n", filename);
+        free(buf_orig); free(buf_gray); free(buf_tmp); free(buf_blur);
+        return -1;
+    }
+    st.t_read = omp_get_wtime() - t_start;
+    if (isCancelled(e, img)) {
+        free(buf_orig); free(buf_gray); free(buf_tmp); free(buf_blur);
+        return 1;
+    }
+
+    // Los espejos no se calculan: son vistas sobre buf_orig y buf_gray que
+    // el codificador recorre invertidas al escribir
+    output_t outputs[N_OUTPUTS] = {
+        { "gris",       { &info, buf_gray, 0, 0 }, 1 },
+        { "esp_h",      { &info, buf_orig, 1, 0 }, 0 },
+        { "esp_v",      { &info, buf_orig, 0, 1 }, 0 },
+        { "esp_h_gris", { &info, buf_gray, 1, 0 }, 1 },
+        { "esp_v_gris", { &info, buf_gray, 0, 1 }, 1 },
+        { "blur",       { &info, buf_blur, 0, 0 }, 0 },
+    };
+
+    // Caché: la clave es el hash de la cabecera de salida y de los píxeles
+    // leídos. La cabecera lleva campos de la entrada (resolución, reservados)
+    // que no son píxeles: dos entradas que sólo difieren en ellos no deben
+    // intercambiarse las salidas.
+    ResultCache *cache = (e->cache && e->cache->dir) ? e->cache : NULL;
+    char cache_paths[N_OUTPUTS][600];
+    if (cache) {
+        uint64_t hash = hashPixels(info.header, BMP_HEADER_SIZE, 0);
+        hash = hashPixels(buf_orig, npix * sizeof(Pixel), hash);
+        for (int o = 0; o < N_OUTPUTS; o++) {
+            int kernel = strcmp(outputs[o].suffix, "blur") == 0 ? e->kernel_size : 0;
+            // La luminancia entera puede diferir de la de float: otra entrada
+            char key_suffix[32];
+            snprintf(key_suffix, sizeof(key_suffix), "%s%s", outputs[o].suffix,
+                     e->fixed_gray && outputs[o].gray ? "-ent" : "");
+            cacheKey(cache_paths[o], sizeof(cache_paths[o]), cache, hash,
+                     info.width, info.height, key_suffix, kernel, e->encoder);
+        }
+        double t0 = omp_get_wtime();
+        if (fromCache(e, cache_paths, outputs, img, deferred)) {
+            st.t_write = omp_get_wtime() - t0;
+            st.t_total = omp_get_wtime() - t_start;
+            st.cached = 1;
+            if (stats) *stats = st;
+            free(buf_orig); free(buf_gray); free(buf_tmp); free(buf_blur);
+            return 0;
+        }
+    }
+
+    double t0 = omp_get_wtime();
+    grayscale(buf_orig, buf_gray, npix, par, e->fixed_gray);
+    st.t_gray = omp_get_wtime() - t0;
+    if (isCancelled(e, img)) {
+        free(buf_orig); free(buf_gray); free(buf_tmp); free(buf_blur);
+        return 1;
+    }
+
+    t0 = omp_get_wtime();
+    boxBlur(buf_orig, buf_tmp, buf_blur, info.width, info.height, e->kernel_size, par);
+    st.t_blur = omp_get_wtime() - t0;
+    if (isCancelled(e, img)) {
+        free(buf_orig); free(buf_gray); free(buf_tmp); free(buf_blur);
+        return 1;
+    }
+
+    // Guardar resultados: cada hilo codifica y escribe (o entrega) una salida.
+    // Una salida que empieza después de la cancelación ya no se genera.
+    t0 = omp_get_wtime();
+    int dropped = 0;
+    if (!e->sink) {
+        #pragma omp parallel for schedule(dynamic, 1) if(par)
+        for (int o = 0; o < N_OUTPUTS; o++) {
+            if (isCancelled(e, img)) {
+                #pragma omp atomic write
+                dropped = 1;
+                continue;
+            }
+            writeImage(e->encoder, img, outputs[o].suffix,
+                       &outputs[o].view, outputs[o].gray, e->kernel_size);
+            if (cache) {
+                char name[128];
+                outputName(name, sizeof(name), e->encoder, img, outputs[o].suffix, e->kernel_size);
+                cacheStoreFile(cache, cache_paths[o], name);
+            }
+        }
+    } else {
+        EncodedOutputs out;
+        memset(&out, 0, sizeof(out));
+        #pragma omp parallel for schedule(dynamic, 1) if(par)
+        for (int o = 0; o < N_OUTPUTS; o++) {
+            if (isCancelled(e, img)) {
+                #pragma omp atomic write
+                dropped = 1;
+                continue;
+            }
+            outputName(out.names[o], sizeof(out.names[o]), e->encoder, img,
+                       outputs[o].suffix, e->kernel_size);
+            out.len[o] = e->encoder->encode(&outputs[o].view, outputs[o].gray, &out.data[o]);
+            if (out.len[o] == 0) {
+                fprintf(stderr, "[ERROR] No se pudo codificar %s\n", out.names[o]);
+                free(out.data[o]);
+                out.data[o] = NULL;
+            } else if (cache) {
+                cacheStoreData(cache, cache_paths[o], out.data[o], out.len[o]);
+            }
+        }
+        if (dropped) {
+            freeEncoded(&out);
+        } else {
+            deliver(e, &out, deferred);
+        }
+    }
+    st.t_write = omp_get_wtime() - t0;
+    st.t_total = omp_get_wtime() - t_start;
+    if (stats) *stats = st;
+
+    free(buf_orig); free(buf_gray); free(buf_tmp); free(buf_blur);
+    return dropped ? 1 : 0;
+}
+
+int processImage(const Engine *e, const char *filename, int img, ImageStats *stats) {
+    int rc = process(e, filename, img, stats, 1, NULL);
+    if (e->cache && e->cache->dir) cacheTrim(e->cache, 0);
+    return rc;
+}
+
+// Píxeles de la imagen según su cabecera, o -1 si no se puede leer
+static long long peekPixels(const char *filename) {
+    FILE *in = fopen(filename, "rb");
+    if (!in) return -1;
+    BmpInfo info;
+    int rc = readHeader(in, &info);
+    fclose(in);
+    return rc == 0 ? (long long)info.width * info.height : -1;
+}
+
+void processBatch(const Engine *e, const char *const *filenames, const int *imgs, int n,
+                  ImageStats *stats, int *status) {
+    // Las imágenes chicas van una por hilo; las grandes, de a una con todos
+    // los hilos dentro de la imagen
+    int *small = malloc(n * sizeof(int));
+    EncodedOutputs *deferred = e->sink ? calloc(n, sizeof(EncodedOutputs)) : NULL;
+    if (!small || (e->sink && !deferred)) {
+        free(small); free(deferred);
+        for (int i = 0; i < n; i++) status[i] = processImage(e, filenames[i], imgs[i], &stats[i]);
+        return;
+    }
+    int n_small = 0;
+    for (int i = 0; i < n; i++) {
+        long long npix = peekPixels(filenames[i]);
+        small[i] = npix >= 0 && npix < SMALL_IMAGE_PIXELS;
+        n_small += small[i];
+    }
+
+    if (n_small > 1) {
+        // Las chicas se consultan una vez, antes de repartirlas entre hilos
+        for (int i = 0; i < n; i++) {
+            status[i] = small[i] && isCancelled(e, imgs[i]) ? 1 : 0;
+        }
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int i = 0; i < n; i++) {
+            if (!small[i] || status[i] == 1) continue;
+            status[i] = process(e, filenames[i], imgs[i], &stats[i], 0,
+                                deferred ? &deferred[i] : NULL);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        if (n_small > 1 && small[i]) {
+            // Entregamos en orden desde este hilo lo que quedó pendiente
+            if (deferred && status[i] == 0) e->sink(&deferred[i], e->sink_arg);
+            continue;
+        }
+        status[i] = process(e, filenames[i], imgs[i], &stats[i], 1, NULL);
+    }
+    if (e->cache && e->cache->dir) cacheTrim(e->cache, 0);
+    free(small);
+    free(deferred);
+}
+
+// --- Autoprueba ------------------------------------------------------------
+
+// Versiones de referencia: las originales, en float y con división
+static void refGrayscale(const Pixel *src, Pixel *dst, size_t npix) {
+    for (size_t j = 0; j < npix; j++) {
+        unsigned char lum = (unsigned char)(
+            0.21f * src[j].r +
+            0.72f * src[j].g +
+            0.07f * src[j].b
+        );
+        dst[j].r = dst[j].g = dst[j].b = lum;
+    }
+}
+
+static void refBoxBlur(const Pixel *src, Pixel *tmp, Pixel *dst,
+                       int width, int height, int kernel) {
+    int k = kernel / 2;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sr=0, sg=0, sb=0, cnt=0;
+            for (int d = -k; d <= k; d++) {
+                int xx = x + d;
+                if (xx >= 0 && xx < width) {
+                    const Pixel *p = &src[(size_t)y * width + xx];
+                    sr += p->r; sg += p->g; sb += p->b; cnt++;
+                }
+            }
+            tmp[(size_t)y * width + x].r = sr / cnt;
+            tmp[(size_t)y * width + x].g = sg / cnt;
+            tmp[(size_t)y * width + x].b = sb / cnt;
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sr=0, sg=0, sb=0, cnt=0;
+            for (int d = -k; d <= k; d++) {
+                int yy = y + d;
+                if (yy >= 0 && yy < height) {
+                    const Pixel *p = &tmp[(size_t)yy * width + x];
+                    sr += p->r; sg += p->g; sb += p->b; cnt++;
+                }
+            }
+            dst[(size_t)y * width + x].r = sr / cnt;
+            dst[(size_t)y * width + x].g = sg / cnt;
+            dst[(size_t)y * width + x].b = sb / cnt;
+        }
+    }
+}
+
+// Imagen de prueba: 0 ruido, 1 blanco (sumas máximas), 2 degradado, 3 tablero
+static void fillTestImage(Pixel *p, int width, int height, int pattern, unsigned seed) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            Pixel *q = &p[(size_t)y * width + x];
+            if (pattern == 0) {
+                seed = seed * 1103515245u + 12345u;
+                q->r = seed >> 24; q->g = seed >> 16; q->b = seed >> 8;
+            } else if (pattern == 1) {
+                q->r = q->g = q->b = 255;
+            } else if (pattern == 2) {
+                q->r = x * 255 / width; q->g = y * 255 / height; q->b = (x + y) & 255;
+            } else {
+                q->r = q->g = q->b = ((x ^ y) & 1) ? 255 : 0;
+            }
+        }
+    }
+}
+
+// Máxima diferencia por canal entre dos buffers (0 = idénticos)
+static int maxDiff(const Pixel *a, const Pixel *b, size_t npix) {
+    int worst = 0;
+    for (size_t j = 0; j < npix; j++) {
+        int d[3] = { a[j].r - b[j].r, a[j].g - b[j].g, a[j].b - b[j].b };
+        for (int c = 0; c < 3; c++) {
+            if (d[c] < 0) d[c] = -d[c];
+            if (d[c] > worst) worst = d[c];
+        }
+    }
+    return worst;
+}
+
+int engineSelfTest(FILE *out) {
+    static const int sizes[][2] = {
+        { 1, 1 }, { 2, 3 }, { 5, 7 }, { 17, 9 }, { 99, 61 }, { 256, 3 },
+        { 3, 300 }, { 300, 257 }, { 640, 480 }, { 4200, 2 },
+    };
+    static const int kernels[] = { 1, 3, 4, 5, 55, 301, 4103, 9001 };
+    int n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    int n_kernels = sizeof(kernels) / sizeof(kernels[0]);
+    int failures = 0, cases = 0;
+
+    // Blur y luminancia en float: deben ser idénticos a la referencia
+    for (int s = 0; s < n_sizes; s++) {
+        int w = sizes[s][0], h = sizes[s][1];
+        size_t npix = (size_t)w * h;
+        Pixel *src = malloc(npix * sizeof(Pixel));
+        Pixel *tmp = malloc(npix * sizeof(Pixel));
+        Pixel *ref = malloc(npix * sizeof(Pixel));
+        Pixel *got = malloc(npix * sizeof(Pixel));
+        if (!src || !tmp || !ref || !got) {
+            fprintf(out, "[AUTOPRUEBA] Error malloc (%dx%d)\n", w, h);
+            free(src); free(tmp); free(ref); free(got);
+            return failures + 1;
+        }
+        for (int pattern = 0; pattern < 4; pattern++) {
+            fillTestImage(src, w, h, pattern, 1234u + s);
+
+            refGrayscale(src, ref, npix);
+            grayscale(src, got, npix, 1, 0);
+            cases++;
+            if (maxDiff(ref, got, npix) != 0) {
+                fprintf(out, "[AUTOPRUEBA] FALLA gris float %dx%d patrón %d\n", w, h, pattern);
+                failures++;
+            }
+
+            for (int k = 0; k < n_kernels; k++) {
+                // Los kernels enormes sólo tienen sentido en la imagen ancha
+                if (kernels[k] > 301 && w < 4000) continue;
+                refBoxBlur(src, tmp, ref, w, h, kernels[k]);
+                for (int par = 0; par <= 1; par++) {
+                    boxBlur(src, tmp, got, w, h, kernels[k], par);
+                    cases++;
+                    int d = maxDiff(ref, got, npix);
+                    if (d != 0) {
+                        fprintf(out, "[AUTOPRUEBA] FALLA blur %dx%d k=%d patrón %d par=%d (dif %d)\n",
+                                w, h, kernels[k], pattern, par, d);
+                        failures++;
+                    }
+                }
+            }
+        }
+        free(src); free(tmp); free(ref); free(got);
+    }
+
+    // Luminancia entera: todos los colores, de 65536 en 65536 (r fijo)
+    Pixel *src = malloc(65536 * sizeof(Pixel));
+    Pixel *ref = malloc(65536 * sizeof(Pixel));
+    Pixel *got = malloc(65536 * sizeof(Pixel));
+    if (!src || !ref || !got) {
+        fprintf(out, "[AUTOPRUEBA] Error malloc (colores)\n");
+        free(src); free(ref); free(got);
+        return failures + 1;
+    }
+    long distintos = 0;
+    int worst = 0;
+    for (int r = 0; r < 256; r++) {
+        for (int j = 0; j < 65536; j++) {
+            src[j].r = r; src[j].g = j >> 8; src[j].b = j & 255;
+        }
+        refGrayscale(src, ref, 65536);
+        grayscale(src, got, 65536, 1, 1);
+        for (int j = 0; j < 65536; j++) distintos += ref[j].r != got[j].r;
+        int d = maxDiff(ref, got, 65536);
+        if (d > worst) worst = d;
+    }
+    free(src); free(ref); free(got);
+    cases++;
+    fprintf(out, "[AUTOPRUEBA] Gris entero: %ld de 16777216 colores difieren, dif máx %d (tolerancia %d)\n",
+            distintos, worst, GRAY_FIXED_TOLERANCE);
+    if (worst > GRAY_FIXED_TOLERANCE) failures++;
+
+    fprintf(out, "[AUTOPRUEBA] %d casos, %d fallas\n", cases, failures);
+    return failures;
+}
@@ -0,0 +1,69 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "bmp_utils.h"
+#include "encoders.h"
+#include "cache.h"
+
+// Motor de procesamiento compartido por programa (MPI) y reto_3 (un solo
+// proceso): lee una BMP y genera sus seis salidas. No depende de MPI.
+
+#define N_OUTPUTS 6
+
+// Salidas codificadas de una imagen, listas para escribirse o enviarse
+typedef struct {
+    char names[N_OUTPUTS][128];
+    unsigned char *data[N_OUTPUTS];   // NULL si la salida no se pudo generar
+    size_t len[N_OUTPUTS];
+} EncodedOutputs;
+
+typedef struct {
+    int kernel_size;
+    const Encoder *encoder;
+    ResultCache *cache;      // NULL o cache->dir NULL: sin caché
+    // Si sink no es NULL recibe las salidas codificadas (y se queda con los
+    // buffers) en lugar de escribirlas en salidas/
+    void (*sink)(EncodedOutputs *out, void *arg);
+    void *sink_arg;
+    int fixed_gray;          // luminancia en punto fijo en lugar de float
+    // Si cancelled no es NULL se consulta antes de cada imagen, entre sus
+    // etapas y antes de cada salida, desde cualquier hilo del equipo; si
+    // devuelve 1, la imagen img se abandona (ya la terminó otro worker)
+    int (*cancelled)(int img, void *arg);
+    void *cancel_arg;
+} Engine;
+
+// Diferencia máxima (en niveles de gris) entre la luminancia en punto fijo
+// y la de float; engineSelfTest la verifica sobre los 2^24 colores
+#define GRAY_FIXED_TOLERANCE 1
+
+// Tiempos por etapa de una imagen, en segundos
+typedef struct {
+    double t_read, t_gray, t_blur, t_write, t_total;
+    int width, height;
+    int cached;              // las salidas salieron de la caché
+} ImageStats;
+
+// Debajo de este número de píxeles no conviene repartir una imagen entre
+// hilos: el costo de crear y sincronizar el equipo supera al trabajo
+#define SMALL_IMAGE_PIXELS (256 * 256)
+
+// Procesa filename; las salidas se nombran <img>_<sufijo>_<kernel>.<ext>.
+// Devuelve 0 si terminó, -1 si la imagen no se pudo leer, 1 si se canceló.
+int processImage(const Engine *e, const char *filename, int img, ImageStats *stats);
+
+// Procesa un lote: las imágenes chicas en paralelo (una por hilo) y las
+// grandes una tras otra con paralelismo dentro de cada imagen. status[i]
+// recibe lo que processImage devolvería para filenames[i]. El sumidero se
+// llama sólo desde el hilo que llama, en el orden del lote.
+void processBatch(const Engine *e, const char *const *filenames, const int *imgs, int n,
+                  ImageStats *stats, int *status);
+
+// Autoprueba de regresión: compara los núcleos optimizados (blur por
+// recíprocos y ventana deslizante, luminancia entera) contra la versión de
+// referencia en float y con división sobre imágenes generadas. El blur y
+// la luminancia en float deben ser idénticos; la entera, dentro de
+// GRAY_FIXED_TOLERANCE. Escribe un informe en out y devuelve el número de fallas.
+int engineSelfTest(FILE *out);
+
+#endif
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <math.h>
 #include <mpi.h>
 #include <omp.h>
 #include <sys/stat.h>
@@ -8,14 +10,516 @@
 #include <unistd.h>
 #include <pthread.h>
 #include "bmp_utils.h"
+#include "engine.h"
 
 #define TASK_REQUEST      1
 #define TASK_ASSIGNMENT   2
 #define NO_MORE_TASKS     3
 #define HEARTBEAT_TAG     4     
+#define OUTPUT_NAME_TAG   5     // worker -> rango de E/S: nombre del archivo
+#define OUTPUT_DATA_TAG   6     // worker -> rango de E/S: contenido codificado
+#define IO_DONE_TAG       7     // el worker indicado ya no enviará más salidas
+#define TASK_CANCEL       8     // maestro -> worker: su lote ya lo terminaron otros
+
+#define TASK_BATCH_MAX    8     // máximo de imágenes por asignación
+#define OUTBOX_MAX        4     // imágenes del maestro pendientes de envío a E/S
+
+#define HEARTBEAT_PERIOD  1.0   // segundos entre latidos de cada worker
+#define PHI_WINDOW        64    // intervalos entre latidos recordados por worker
+#define PHI_THRESHOLD     8.0   // sospecha a partir de la cual el worker está muerto
+#define PHI_MIN_STD       (HEARTBEAT_PERIOD / 2)
 
 static int KERNEL_SIZE = 55;
+static const Encoder *ENCODER = NULL;
+// Rangos 1..IO_RANKS sólo reciben y escriben salidas; 0 = cada worker escribe
+static int IO_RANKS = 0;
+// Caché de resultados por contenido (desactivada si CACHE.dir es NULL)
+static ResultCache CACHE;
+// Luminancia en punto fijo (-e) en lugar de float
+static int FIXED_GRAY = 0;
+
+// Salidas de una imagen en tránsito hacia el rango de E/S. Los buffers
+// deben vivir hasta que terminen los MPI_Isend (antes de la siguiente imagen).
+typedef struct {
+    EncodedOutputs out;
+    MPI_Request reqs[2 * N_OUTPUTS];
+    int n_reqs;
+    int io_rank;
+} pending_outputs_t;
+
+// Rango de E/S que recibe las salidas de un worker (reparto round-robin).
+// El maestro usa el último, que es el que recibe menos workers.
+static int io_rank_of(int worker) {
+    if (worker == 0) return IO_RANKS;
+    return 1 + (worker - IO_RANKS - 1) % IO_RANKS;
+}
+
+// El maestro avisa IO_DONE en nombre de un worker sólo cuando MPI reportó
+// que ya no se puede comunicar con él. Un worker sospechoso por el detector
+// puede seguir vivo con envíos en curso: ése manda su propio IO_DONE al
+// terminar, después de que todas sus salidas llegaron.
+static void io_done_for(int worker) {
+    if (IO_RANKS > 0) {
+        MPI_Send(&worker, 1, MPI_INT, io_rank_of(worker), IO_DONE_TAG, MPI_COMM_WORLD);
+    }
+}
+
+static void wait_pending_outputs(pending_outputs_t *p) {
+    MPI_Waitall(p->n_reqs, p->reqs, MPI_STATUSES_IGNORE);
+    for (int o = 0; o < N_OUTPUTS; o++) {
+        free(p->out.data[o]);
+        p->out.data[o] = NULL;
+    }
+    p->n_reqs = 0;
+}
+
+// ¿Terminaron los envíos? Si es así libera los buffers (no bloquea)
+static int test_pending_outputs(pending_outputs_t *p) {
+    int flag;
+    MPI_Testall(p->n_reqs, p->reqs, &flag, MPI_STATUSES_IGNORE);
+    if (flag) wait_pending_outputs(p);
+    return flag;
+}
+
+// Manda (nombre, contenido) de cada salida de p->out con MPI_Isend
+static void send_pending_outputs(pending_outputs_t *p) {
+    for (int o = 0; o < N_OUTPUTS; o++) {
+        if (!p->out.data[o]) continue;
+        MPI_Isend(p->out.names[o], sizeof(p->out.names[o]), MPI_CHAR, p->io_rank,
+                  OUTPUT_NAME_TAG, MPI_COMM_WORLD, &p->reqs[p->n_reqs++]);
+        MPI_Isend(p->out.data[o], (int)p->out.len[o], MPI_BYTE, p->io_rank,
+                  OUTPUT_DATA_TAG, MPI_COMM_WORLD, &p->reqs[p->n_reqs++]);
+    }
+}
+
+// Sumidero del motor en modo E/S: espera los envíos de la imagen anterior y
+// manda los de la nueva
+static void io_sink(EncodedOutputs *out, void *arg) {
+    pending_outputs_t *p = arg;
+    wait_pending_outputs(p);
+    p->out = *out;
+    send_pending_outputs(p);
+}
+
+// Bandeja de salidas del hilo de cómputo del maestro en modo E/S. Ese hilo
+// no llama a MPI: deja cada imagen aquí y el bucle del maestro hace los
+// MPI_Isend y libera los buffers cuando terminan.
+typedef struct outbox_item {
+    pending_outputs_t p;
+    struct outbox_item *next;
+} outbox_item_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    outbox_item_t *queued, **queued_tail;   // entregadas, sin enviar (en orden)
+    outbox_item_t *sending;                 // con envíos en curso
+    int count;                              // queued + sending
+} outbox_t;
+
+static void outbox_init(outbox_t *b) {
+    pthread_mutex_init(&b->lock, NULL);
+    b->queued = b->sending = NULL;
+    b->queued_tail = &b->queued;
+    b->count = 0;
+}
+
+// Sumidero del hilo local: espera si ya hay OUTBOX_MAX imágenes en la
+// bandeja, para no acumular en memoria más de lo que la red despacha
+static void outbox_sink(EncodedOutputs *out, void *arg) {
+    outbox_t *b = arg;
+    outbox_item_t *item = calloc(1, sizeof(outbox_item_t));
+    if (!item) {
+        fprintf(stderr, "[MAESTRO] Error malloc bandeja de salidas\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    item->p.out = *out;
+    item->p.io_rank = io_rank_of(0);
+
+    pthread_mutex_lock(&b->lock);
+    while (b->count >= OUTBOX_MAX) {
+        pthread_mutex_unlock(&b->lock);
+        usleep(1000);
+        pthread_mutex_lock(&b->lock);
+    }
+    *b->queued_tail = item;
+    b->queued_tail = &item->next;
+    b->count++;
+    pthread_mutex_unlock(&b->lock);
+}
+
+// Desde el hilo de MPI: envía lo que dejó el hilo local y libera lo que ya
+// llegó. Con wait, espera a que todo termine.
+static void outbox_flush(outbox_t *b, int wait) {
+    pthread_mutex_lock(&b->lock);
+    outbox_item_t *nuevos = b->queued;
+    b->queued = NULL;
+    b->queued_tail = &b->queued;
+    pthread_mutex_unlock(&b->lock);
+
+    while (nuevos) {
+        outbox_item_t *item = nuevos;
+        nuevos = item->next;
+        send_pending_outputs(&item->p);
+        item->next = b->sending;
+        b->sending = item;
+    }
+
+    int liberados = 0;
+    for (outbox_item_t **it = &b->sending; *it; ) {
+        outbox_item_t *item = *it;
+        if (wait) {
+            wait_pending_outputs(&item->p);
+        } else if (!test_pending_outputs(&item->p)) {
+            it = &item->next;
+            continue;
+        }
+        *it = item->next;
+        free(item);
+        liberados++;
+    }
+    pthread_mutex_lock(&b->lock);
+    b->count -= liberados;
+    pthread_mutex_unlock(&b->lock);
+}
 
+// Bucle de un rango de E/S: recibe (nombre, contenido) de sus workers y lo
+// escribe en su disco local hasta que todos ellos avisan IO_DONE
+static void io_rank_loop(int rank, int size) {
+    int n_workers = 0;
+    char *finished = calloc(size, 1);
+    if (!finished) {
+        fprintf(stderr, "[E/S %d] Error malloc finished\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    // Productores: los workers que le tocan y, al último, el maestro
+    for (int w = 0; w < size; w++) {
+        if ((w == 0 || w > IO_RANKS) && io_rank_of(w) == rank) n_workers++;
+    }
+
+    long files = 0;
+    double bytes = 0.0;
+    double t0 = MPI_Wtime();
+    while (n_workers > 0) {
+        MPI_Status status;
+        MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        int src = status.MPI_SOURCE;
+
+        if (status.MPI_TAG == IO_DONE_TAG) {
+            int worker;
+            MPI_Recv(&worker, 1, MPI_INT, src, IO_DONE_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            if (!finished[worker]) {
+                finished[worker] = 1;
+                n_workers--;
+            }
+        } else if (status.MPI_TAG == OUTPUT_NAME_TAG) {
+            char name[128];
+            MPI_Recv(name, sizeof(name), MPI_CHAR, src, OUTPUT_NAME_TAG,
+                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            // El contenido llega justo después y del mismo worker
+            int len;
+            MPI_Probe(src, OUTPUT_DATA_TAG, MPI_COMM_WORLD, &status);
+            MPI_Get_count(&status, MPI_BYTE, &len);
+            unsigned char *data = malloc(len > 0 ? len : 1);
+            if (!data) {
+                fprintf(stderr, "[E/S %d] Error malloc salida %s\n", rank, name);
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            }
+            MPI_Recv(data, len, MPI_BYTE, src, OUTPUT_DATA_TAG,
+                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            writeEncoded(name, data, len);
+            free(data);
+            files++;
+            bytes += len;
+        } else {
+            fprintf(stderr, "[E/S %d] Mensaje inesperado (tag %d) de %d\n",
+                    rank, status.MPI_TAG, src);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+    }
+    double dt = MPI_Wtime() - t0;
+    printf("[E/S %d] Escritos %ld archivos, %.1f MB (%.1f MB/s)\n",
+           rank, files, bytes / 1e6, dt > 0 ? bytes / 1e6 / dt : 0.0);
+    fflush(stdout);
+    free(finished);
+}
+
+
+// Detector de fallas phi-accrual: en lugar de un timeout fijo, estima la
+// distribución (normal) de los intervalos entre latidos de cada worker y
+// mide qué tan improbable es el silencio actual. phi = -log10(P(llegar tan
+// tarde)), así que phi = 8 equivale a una probabilidad de 1e-8.
+typedef struct {
+    double last;                   // llegada del último latido
+    double intervals[PHI_WINDOW];  // ventana circular de intervalos
+    int n, pos;
+} phi_detector_t;
+
+static void phi_sample(phi_detector_t *d, double interval) {
+    d->intervals[d->pos] = interval;
+    d->pos = (d->pos + 1) % PHI_WINDOW;
+    if (d->n < PHI_WINDOW) d->n++;
+}
+
+static void phi_init(phi_detector_t *d, double now) {
+    d->last = now;
+    d->n = d->pos = 0;
+    // Arrancamos con el periodo nominal hasta tener muestras reales
+    phi_sample(d, HEARTBEAT_PERIOD);
+    phi_sample(d, HEARTBEAT_PERIOD);
+}
+
+static void phi_heartbeat(phi_detector_t *d, double now) {
+    phi_sample(d, now - d->last);
+    d->last = now;
+}
+
+static double phi_value(const phi_detector_t *d, double now) {
+    double mean = 0.0, var = 0.0;
+    for (int i = 0; i < d->n; i++) mean += d->intervals[i];
+    mean /= d->n;
+    for (int i = 0; i < d->n; i++) {
+        double dev = d->intervals[i] - mean;
+        var += dev * dev;
+    }
+    double std = sqrt(var / d->n);
+    if (std < PHI_MIN_STD) std = PHI_MIN_STD;
+
+    double p_later = 0.5 * erfc((now - d->last - mean) / (std * sqrt(2.0)));
+    return p_later > 1e-300 ? -log10(p_later) : 300.0;
+}
+
+// Un worker dado por muerto volvió a dar señales (latido o petición): el
+// detector se equivocó. Vuelve a contar como activo, con la ventana de
+// intervalos reiniciada; su lote ya se reencoló al sospechar de él.
+static void phi_revive(phi_detector_t *d, int w, double now, int *alive, int *suspected,
+                       int *active_workers) {
+    printf("[MAESTRO] Worker %d dado por muerto volvió a responder; se reincorpora.\n", w);
+    fflush(stdout);
+    phi_init(d, now);
+    alive[w] = 1;
+    suspected[w] = 0;
+    (*active_workers)++;
+}
+
+// Estado de planificación del maestro
+typedef struct {
+    int *queue, head, tail;  // cola de tareas por asignar
+    int *done;               // la tarea ya terminó en algún worker
+    int *copies;             // workers vivos que la están ejecutando
+    int *speculated;         // ya se lanzó una copia especulativa
+    double *start;           // inicio de la ejecución más antigua
+    int remaining;           // tareas sin terminar
+} sched_t;
+
+// Un worker dejó de ejecutar la tarea (murió); si nadie más la tiene, se reencola
+static void sched_release(sched_t *s, int task) {
+    if (task < 0) return;
+    s->copies[task]--;
+    if (!s->done[task] && s->copies[task] == 0) {
+        s->queue[s->tail++] = task;
+        s->speculated[task] = 0;
+    }
+}
+
+// Un worker dejó de ejecutar todas las tareas de su lote
+static void sched_release_all(sched_t *s, int *tasks, int *n) {
+    for (int i = 0; i < *n; i++) sched_release(s, tasks[i]);
+    *n = 0;
+}
+
+static void sched_complete(sched_t *s, int task) {
+    if (task < 0 || s->done[task]) return;
+    s->done[task] = 1;
+    s->remaining--;
+}
+
+// ¿La tarea ya está en el lote del worker?
+static int sched_holds(const int *tasks, int n, int task) {
+    for (int i = 0; i < n; i++) {
+        if (tasks[i] == task) return 1;
+    }
+    return 0;
+}
+
+// Siguiente tarea para un worker ocioso que ya tiene tasks[0..n). Si la cola
+// está vacía, duplica la tarea en curso más antigua que aún no tenga copia:
+// así un worker lento o muerto no define la latencia final. Nunca duplica
+// una tarea del propio lote (recién tomada, parecería la más antigua).
+// Devuelve -1 si no hay nada que dar.
+static int sched_next(sched_t *s, double now, const int *tasks, int n, int *speculative) {
+    *speculative = 0;
+    while (s->head < s->tail) {
+        int task = s->queue[s->head++];
+        if (s->done[task]) continue;
+        s->copies[task]++;
+        s->start[task] = now;
+        return task;
+    }
+
+    int slowest = -1;
+    for (int t = 0; t < s->tail; t++) {
+        int task = s->queue[t];
+        if (s->done[task] || s->speculated[task] || s->copies[task] != 1) continue;
+        if (sched_holds(tasks, n, task)) continue;
+        if (slowest < 0 || s->start[task] < s->start[slowest]) slowest = task;
+    }
+    if (slowest >= 0) {
+        s->speculated[slowest] = 1;
+        s->copies[slowest]++;
+        *speculative = 1;
+    }
+    return slowest;
+}
+
+// Lote de hasta want tareas para un worker. Una copia especulativa cierra
+// el lote, para no concentrar las copias en un solo worker. Devuelve
+// cuántas tomó; *speculative indica si la última es una copia.
+static int sched_take(sched_t *s, double now, int want, int *tasks, int *speculative) {
+    int n = 0;
+    *speculative = 0;
+    while (n < want && !*speculative) {
+        int task = sched_next(s, now, tasks, n, speculative);
+        if (task < 0) break;
+        tasks[n++] = task;
+    }
+    return n;
+}
+
+// Lote en curso de un worker (o del hilo de cómputo del maestro). El
+// motor pregunta por cada imagen si hay que abandonarla, desde cualquiera
+// de sus hilos: la imagen img es la tarea img - 2 (ver run_batch).
+typedef struct {
+    const int *tasks;
+    int n;
+    volatile int dropped[TASK_BATCH_MAX];   // otro worker ya la terminó
+    pthread_t owner;                        // único hilo que llama a MPI
+} batch_state_t;
+
+static int batch_index(const batch_state_t *b, int img) {
+    for (int i = 0; i < b->n; i++) {
+        if (b->tasks[i] + 2 == img) return i;
+    }
+    return -1;
+}
+
+// Hilo de cómputo del maestro: toma tareas del mismo planificador que los
+// workers remotos. No llama a MPI; el acceso a sched se protege con lock.
+typedef struct {
+    sched_t *sched;
+    pthread_mutex_t *lock;
+    const char *filenames;     // buffer de nombres (512 bytes cada uno)
+    Engine engine;
+    batch_state_t batch;
+    volatile int finished;     // ya no quedan tareas que tomar
+} local_args_t;
+
+// Gancho de cancelación del hilo local: consulta directamente el planificador
+static int local_cancelled(int img, void *arg) {
+    local_args_t *a = arg;
+    int i = batch_index(&a->batch, img);
+    if (i < 0) return 0;
+    pthread_mutex_lock(a->lock);
+    int done = a->sched->done[a->batch.tasks[i]];
+    pthread_mutex_unlock(a->lock);
+    return done;
+}
+
+// Gancho de cancelación de un worker: el hilo principal recibe los
+// TASK_CANCEL pendientes (listas de tareas ya terminadas) y marca las de su
+// lote; los demás hilos sólo leen las marcas. Uno que llega tarde, de un
+// lote anterior, no coincide: una tarea terminada no se reasigna.
+static int worker_cancelled(int img, void *arg) {
+    batch_state_t *b = arg;
+    int flag = 0;
+    MPI_Status status;
+    if (pthread_equal(pthread_self(), b->owner)) {
+        MPI_Iprobe(0, TASK_CANCEL, MPI_COMM_WORLD, &flag, &status);
+    }
+    while (flag) {
+        int done[TASK_BATCH_MAX], n_done;
+        MPI_Recv(done, TASK_BATCH_MAX, MPI_INT, 0, TASK_CANCEL, MPI_COMM_WORLD, &status);
+        MPI_Get_count(&status, MPI_INT, &n_done);
+        for (int j = 0; j < n_done; j++) {
+            int i = batch_index(b, done[j] + 2);
+            if (i >= 0) b->dropped[i] = 1;
+        }
+        MPI_Iprobe(0, TASK_CANCEL, MPI_COMM_WORLD, &flag, &status);
+    }
+    int i = batch_index(b, img);
+    return i >= 0 && b->dropped[i];
+}
+
+// Procesa un lote e informa cada imagen terminada; b (si no es NULL) es el
+// estado que consulta el gancho de cancelación del motor. Devuelve cuántas
+// tareas pedir la próxima vez: si todas eran chicas, varias para repartirlas
+// entre los hilos (una imagen por hilo); si no, una.
+static int run_batch(const Engine *e, const char *who, const char **names,
+                     const int *tasks, int n, batch_state_t *b) {
+    int imgs[TASK_BATCH_MAX], status[TASK_BATCH_MAX];
+    ImageStats stats[TASK_BATCH_MAX];
+    for (int i = 0; i < TASK_BATCH_MAX; i++) imgs[i] = i < n ? tasks[i] + 2 : 0;
+    if (b) {
+        b->tasks = tasks;
+        b->n = n;
+        for (int i = 0; i < TASK_BATCH_MAX; i++) b->dropped[i] = 0;
+    }
+    processBatch(e, names, imgs, n, stats, status);
+
+    int all_small = 1;
+    for (int i = 0; i < n; i++) {
+        if (status[i] == 1) {
+            printf("%s Descartada imagen %d: ya la terminó otro worker\n", who, tasks[i]);
+            continue;
+        }
+        if (status[i] != 0) {
+            fprintf(stderr, "%s [ERROR] No se pudo procesar %s\n", who, names[i]);
+            continue;
+        }
+        printf("%s Terminó imagen %d%s\n", who, tasks[i], stats[i].cached ? " (caché)" : "");
+        if ((long long)stats[i].width * stats[i].height >= SMALL_IMAGE_PIXELS) all_small = 0;
+    }
+    fflush(stdout);
+
+    int want = 2 * omp_get_max_threads();
+    return all_small ? (want < TASK_BATCH_MAX ? want : TASK_BATCH_MAX) : 1;
+}
+
+void *local_compute_thread(void *arg) {
+    local_args_t *a = (local_args_t *) arg;
+    // El número de hilos OpenMP es por hilo: lo fijamos también aquí
+    omp_set_num_threads(4);
+
+    int want = 1;
+    while (1) {
+        pthread_mutex_lock(a->lock);
+        if (a->sched->remaining == 0) {
+            pthread_mutex_unlock(a->lock);
+            break;
+        }
+        int tasks[TASK_BATCH_MAX], especulativa;
+        int n = sched_take(a->sched, omp_get_wtime(), want, tasks, &especulativa);
+        pthread_mutex_unlock(a->lock);
+
+        if (n == 0) {
+            // Todo está en curso en otros workers; esperamos por si se reencola
+            usleep(10000);
+            continue;
+        }
+
+        const char *names[TASK_BATCH_MAX];
+        for (int i = 0; i < n; i++) names[i] = &a->filenames[tasks[i] * 512];
+        want = run_batch(&a->engine, "[MAESTRO]", names, tasks, n, &a->batch);
+
+        pthread_mutex_lock(a->lock);
+        for (int i = 0; i < n; i++) {
+            sched_complete(a->sched, tasks[i]);
+            a->sched->copies[tasks[i]]--;
+        }
+        pthread_mutex_unlock(a->lock);
+    }
+    a->finished = 1;
+    return NULL;
+}
 
 // Estructura para pasar parámetros al hilo de heartbeat en workers
 typedef struct {
@@ -24,7 +528,8 @@ typedef struct {
     volatile int *keep_running;  // bandera para detener el hilo
 } hb_args_t;
 
-// Hilo que, en cada worker, envía un heartbeat al maestro cada 2 s
+// Hilo que, en cada worker, envía un heartbeat al maestro cada segundo.
+// Llama a MPI desde un segundo hilo: requiere MPI_THREAD_MULTIPLE.
 void *heartbeat_thread(void *arg) {
     hb_args_t *a = (hb_args_t *) arg;
     int rank = a->rank;
@@ -36,12 +541,18 @@ void *heartbeat_thread(void *arg) {
         if (rc != MPI_SUCCESS) {
             break;
         }
-        sleep(1); 
+        sleep((unsigned) HEARTBEAT_PERIOD);
     }
     return NULL;
 }
 
 
+// ¿El nombre termina en .bmp (sin distinguir mayúsculas)?
+static int has_bmp_extension(const char *name) {
+    size_t len = strlen(name);
+    return len > 4 && strcasecmp(name + len - 4, ".bmp") == 0;
+}
+
 // Recolecta todos los nombres de archivos .bmp en un directorio
 char **get_filenames_from_dir(const char *dirname, int *count) {
     DIR *dir;
@@ -63,7 +574,10 @@ char **get_filenames_from_dir(const char *dirname, int *count) {
     }
 
     while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_type == DT_REG && strstr(entry->d_name, ".bmp")) {
+        // DT_UNKNOWN: el sistema de archivos no informa el tipo; la
+        // validación de cabeceras descarta lo que no sea un archivo BMP
+        if ((entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN) &&
+            has_bmp_extension(entry->d_name)) {
             if (*count >= capacity) {
                 capacity *= 2;
                 filenames = realloc(filenames, capacity * sizeof(char *));
@@ -91,7 +605,9 @@ int main(int argc, char *argv[]) {
     char hostname[MPI_MAX_PROCESSOR_NAME];
     int hostname_len;
 
-    MPI_Init(&argc, &argv);
+    // El hilo de heartbeat llama a MPI en paralelo con el hilo principal
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     MPI_Get_processor_name(hostname, &hostname_len);
@@ -99,34 +615,100 @@ int main(int argc, char *argv[]) {
     // Establecemos handler para que MPI_ERRORS_RETURN funcione
     MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_RETURN);
 
+    // Los heartbeats sólo se usan si todos los procesos tienen THREAD_MULTIPLE
+    int min_provided;
+    MPI_Allreduce(&provided, &min_provided, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    int heartbeats = (min_provided >= MPI_THREAD_MULTIPLE);
+    if (!heartbeats && rank == 0) {
+        printf("[MAESTRO] MPI sin MPI_THREAD_MULTIPLE: heartbeats desactivados\n");
+    }
+
     omp_set_num_threads(4);
     printf("[RANK %d] Usando 4 threads por proceso en host %s\n", rank, hostname);
 
-    if (argc != 3) {
-        if (rank == 0)
-            fprintf(stderr, "Uso: %s <KERNEL_SIZE> <DIRECTORIO_IMAGENES>\n", argv[0]);
+    // Opciones: -f <bmp|bmp8|qoi> elige el formato de salida,
+    //           -i <N> dedica los rangos 1..N a recibir y escribir salidas,
+    //           -c <DIR> activa la caché de resultados, -m <MB> su límite,
+    //           -e usa luminancia en punto fijo (ver GRAY_FIXED_TOLERANCE)
+    const char *formato = "bmp";
+    const char *cache_dir = NULL;
+    long cache_mb = 1024;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:i:c:m:e")) != -1) {
+        if (opt == 'e') {
+            FIXED_GRAY = 1;
+        } else if (opt == 'f') {
+            formato = optarg;
+        } else if (opt == 'i') {
+            IO_RANKS = atoi(optarg);
+        } else if (opt == 'c') {
+            cache_dir = optarg;
+        } else if (opt == 'm') {
+            cache_mb = atol(optarg);
+        } else {
+            argc = 0;  // fuerza el mensaje de uso
+            break;
+        }
+    }
+    ENCODER = getEncoder(formato);
+    if (argc - optind != 2 || !ENCODER || IO_RANKS < 0 || IO_RANKS > size - 1) {
+        if (rank == 0) {
+            fprintf(stderr, "Uso: %s [-f bmp|bmp8|qoi] [-i RANGOS_ES] [-c DIR_CACHE [-m MB]] [-e] <KERNEL_SIZE> <DIRECTORIO_IMAGENES>\n", argv[0]);
+            fprintf(stderr, "     RANGOS_ES no puede incluir al maestro (máximo %d)\n", size - 1);
+        }
         MPI_Finalize();
         return EXIT_FAILURE;
     }
-    KERNEL_SIZE = atoi(argv[1]);
-    char *image_dir = argv[2];
+    KERNEL_SIZE = atoi(argv[optind]);
+    char *image_dir = argv[optind + 1];
+    // El maestro y los workers usan la caché (cada host tiene la suya)
+    cacheInit(&CACHE, (rank == 0 || rank > IO_RANKS) ? cache_dir : NULL, cache_mb);
 
     if (rank == 0) {
-        int total_images = 0;
-        char **image_files = get_filenames_from_dir(image_dir, &total_images);
-        printf("[MAESTRO] Encontradas %d imágenes en %s\n", total_images, image_dir);
+        int found = 0;
+        char **image_files = get_filenames_from_dir(image_dir, &found);
+        printf("[MAESTRO] Encontradas %d imágenes en %s\n", found, image_dir);
+
+        // Validamos las cabeceras en paralelo (es casi todo espera de E/S);
+        // sólo se reparten las que se pueden procesar, en el orden del directorio
+        BmpInfo *infos = malloc((size_t)(found > 0 ? found : 1) * sizeof(BmpInfo));
+        int *valid = malloc((size_t)(found > 0 ? found : 1) * sizeof(int));
+        if (!infos || !valid) {
+            fprintf(stderr, "[MAESTRO] Error malloc validación\n");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        #pragma omp parallel for schedule(dynamic, 8)
+        for (int i = 0; i < found; i++) {
+            FILE *f = fopen(image_files[i], "rb");
+            valid[i] = f && readHeader(f, &infos[i]) == 0;
+            if (f) fclose(f);
+            if (!valid[i]) {
+                fprintf(stderr, "[MAESTRO] Se descarta %s: no es un BMP soportado\n", image_files[i]);
+            }
+        }
 
         // Preparamos buffer de nombres (cada nombre 512 bytes)
-        char *filenames_buffer = malloc((size_t)total_images * 512);
+        char *filenames_buffer = malloc((size_t)(found > 0 ? found : 1) * 512);
         if (!filenames_buffer) {
             fprintf(stderr, "[MAESTRO] Error malloc filenames_buffer\n");
             MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
-        for (int i = 0; i < total_images; i++) {
-            strncpy(&filenames_buffer[i * 512], image_files[i], 512);
+        int total_images = 0;
+        long total_leidas = 0;   // píxeles de todas las imágenes válidas
+        for (int i = 0; i < found; i++) {
+            if (valid[i]) {
+                strncpy(&filenames_buffer[total_images * 512], image_files[i], 512);
+                total_leidas += (long)infos[i].width * infos[i].height;
+                total_images++;
+            }
             free(image_files[i]);
         }
         free(image_files);
+        free(infos);
+        free(valid);
+        if (total_images < found) {
+            printf("[MAESTRO] %d de %d archivos descartados\n", found - total_images, found);
+        }
         MPI_Bcast(&total_images, 1, MPI_INT, 0, MPI_COMM_WORLD);
         MPI_Bcast(filenames_buffer, total_images * 512, MPI_CHAR, 0, MPI_COMM_WORLD);
 
@@ -135,185 +717,287 @@ int main(int argc, char *argv[]) {
             perror("[MAESTRO] Error abrir estadisticas.txt");
             MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
-
-        FILE *tmpf = fopen(&filenames_buffer[0], "rb");
-        if (!tmpf) {
-            perror("[MAESTRO] Error abrir imagen inicial");
-            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-        }
-        readHeader(tmpf);
-        fclose(tmpf);
-        int width_local = width, height_local = height;
-        size_t npix = (size_t)width * height;
-        printf("[MAESTRO] Dimensiones: width=%d, height=%d, npix=%zu\n",
-               width_local, height_local, npix);
+        printf("[MAESTRO] %d imágenes válidas, %ld píxeles en total\n",
+               total_images, total_leidas);
 
         createFolder("salidas");
         MPI_Barrier(MPI_COMM_WORLD);
-        const double HEARTBEAT_INTERVAL = 60.0;  
-        const int    MAX_MISSED         = 3;
-        double *last_heartbeat = calloc(size, sizeof(double));
-        if (!last_heartbeat) {
-            fprintf(stderr, "[MAESTRO] Error malloc last_heartbeat\n");
-            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-        }
-        int *missed = calloc(size, sizeof(int));
-        if (!missed) {
-            fprintf(stderr, "[MAESTRO] Error malloc missed\n");
+        phi_detector_t *detector = malloc(size * sizeof(phi_detector_t));
+        if (!detector) {
+            fprintf(stderr, "[MAESTRO] Error malloc detector\n");
             MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
-
-        double now = MPI_Wtime();
-        for (int i = 1; i < size; i++) {
-            last_heartbeat[i] = now;
-            missed[i]  = 0;
-        }
-        int *assigned_task = malloc(size * sizeof(int));
-        if (!assigned_task) {
-            fprintf(stderr, "[MAESTRO] Error malloc assigned_task\n");
+        // assigned[w * TASK_BATCH_MAX ..]: lote en curso del worker w
+        int *assigned = malloc((size_t)size * TASK_BATCH_MAX * sizeof(int));
+        int *n_assigned = calloc(size, sizeof(int));
+        if (!assigned || !n_assigned) {
+            fprintf(stderr, "[MAESTRO] Error malloc assigned\n");
             MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
-        for (int i = 0; i < size; i++) {
-            assigned_task[i] = -1;
-        }
         int *alive = malloc(size * sizeof(int));
         if (!alive) {
             fprintf(stderr, "[MAESTRO] Error malloc alive\n");
             MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
-        for (int i = 0; i < size; i++) {
-            alive[i] = (i == 0 ? 0 : 1); 
+        // waiting[w]: cuántas tareas pidió el worker que espera respuesta (0 = ninguna)
+        int *waiting = calloc(size, sizeof(int));
+        if (!waiting) {
+            fprintf(stderr, "[MAESTRO] Error malloc waiting\n");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        // suspected[w]: dado por muerto por el detector y aún sin despedir
+        int *suspected = calloc(size, sizeof(int));
+        if (!suspected) {
+            fprintf(stderr, "[MAESTRO] Error malloc suspected\n");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        // cancel_sent[w]: ya se le avisó que su lote lo terminaron otros
+        int *cancel_sent = calloc(size, sizeof(int));
+        if (!cancel_sent) {
+            fprintf(stderr, "[MAESTRO] Error malloc cancel_sent\n");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
 
-        int *task_queue = malloc(sizeof(int) * (2 * total_images));
-        if (!task_queue) {
-            fprintf(stderr, "[MAESTRO] Error malloc task_queue\n");
+        // Cada worker muere a lo más una vez y puede reencolar su lote
+        // completo: total_images + size * TASK_BATCH_MAX basta
+        sched_t sched;
+        sched.queue = malloc(sizeof(int) * ((size_t)total_images + (size_t)size * TASK_BATCH_MAX));
+        sched.done = calloc(total_images, sizeof(int));
+        sched.copies = calloc(total_images, sizeof(int));
+        sched.speculated = calloc(total_images, sizeof(int));
+        sched.start = calloc(total_images, sizeof(double));
+        if (!sched.queue || !sched.done || !sched.copies ||
+            !sched.speculated || !sched.start) {
+            fprintf(stderr, "[MAESTRO] Error malloc planificador\n");
             MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
-        int queue_head = 0, queue_tail = total_images;
+        sched.head = 0;
+        sched.tail = total_images;
+        sched.remaining = total_images;
         for (int i = 0; i < total_images; i++) {
-            task_queue[i] = i;
+            sched.queue[i] = i;
+        }
+
+        // Los rangos de E/S no procesan imágenes; el maestro lo hace en un
+        // hilo aparte (más abajo) sin contar como worker remoto
+        double now = MPI_Wtime();
+        for (int i = 0; i < size; i++) {
+            phi_init(&detector[i], now);
+            alive[i] = (i > IO_RANKS);
         }
-        int active_workers = size - 1;
+
+        int active_workers = size - 1 - IO_RANKS;
         MPI_Status status;
         double start_time = MPI_Wtime();
-        while (active_workers > 0) {
+
+        // Hilo de cómputo local: con -n 1 es el único que procesa
+        pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+        local_args_t local_args;
+        local_args.sched = &sched;
+        local_args.lock = &sched_lock;
+        local_args.filenames = filenames_buffer;
+        local_args.engine = (Engine){ KERNEL_SIZE, ENCODER, &CACHE, NULL, NULL, FIXED_GRAY,
+                                      local_cancelled, &local_args };
+        // Con rangos de E/S, lo que procesa el maestro también va a ellos
+        outbox_t outbox;
+        outbox_init(&outbox);
+        if (IO_RANKS > 0) {
+            local_args.engine.sink = outbox_sink;
+            local_args.engine.sink_arg = &outbox;
+        }
+        local_args.finished = 0;
+        pthread_t local_thread;
+        if (pthread_create(&local_thread, NULL, local_compute_thread, &local_args) != 0) {
+            fprintf(stderr, "[MAESTRO] No se pudo crear hilo de cómputo local\n");
+            if (active_workers == 0) MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            local_args.finished = 1;
+        } else {
+            printf("[MAESTRO] Hilo de cómputo local lanzado.\n");
+            fflush(stdout);
+        }
+        int local_running = !local_args.finished;
+
+        while (active_workers > 0 || !local_args.finished) {
             int flag;
 
+            // 1) Latidos: vaciamos todos los que estén pendientes
             MPI_Iprobe(MPI_ANY_SOURCE, HEARTBEAT_TAG, MPI_COMM_WORLD, &flag, &status);
-            if (flag) {
+            while (flag) {
                 int hb_rank;
                 MPI_Recv(&hb_rank, 1, MPI_INT, status.MPI_SOURCE,
                          HEARTBEAT_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
                 if (alive[hb_rank]) {
-                    last_heartbeat[hb_rank] = MPI_Wtime();
-                    missed[hb_rank]  = 0;  
-
-                    printf("[MAESTRO] Recibido heartbeat de worker %d (missed[%d]=0)\n", hb_rank, hb_rank);
+                    phi_heartbeat(&detector[hb_rank], MPI_Wtime());
+                    printf("[MAESTRO] Recibido heartbeat de worker %d\n", hb_rank);
                     fflush(stdout);
+                } else if (suspected[hb_rank]) {
+                    phi_revive(&detector[hb_rank], hb_rank, MPI_Wtime(), alive, suspected,
+                               &active_workers);
                 }
+                MPI_Iprobe(MPI_ANY_SOURCE, HEARTBEAT_TAG, MPI_COMM_WORLD, &flag, &status);
             }
 
+            // 2) Detector phi-accrual: damos por muerto al worker cuyo
+            //    silencio ya es demasiado improbable y reencolamos su tarea
+            pthread_mutex_lock(&sched_lock);
             double ahora = MPI_Wtime();
+            for (int w = 1; w < size && heartbeats; w++) {
+                if (!alive[w]) continue;
+                double phi = phi_value(&detector[w], ahora);
+                if (phi > PHI_THRESHOLD) {
+                    printf("[MAESTRO] Worker %d marcado como MUERTO (phi=%.1f, %.1f s sin latido). Reasignando %d tarea(s).\n",
+                           w, phi, ahora - detector[w].last, n_assigned[w]);
+                    fflush(stdout);
 
-            for (int w = 1; w < size; w++) {
-                if (alive[w] && assigned_task[w] >= 0) {
-                    double dt = ahora - last_heartbeat[w];
-
-                    if (dt > (missed[w] + 1) * HEARTBEAT_INTERVAL) {
-                        missed[w]++;
-                        printf("[MAESTRO] Worker %d: latido tardío #%d (dt=%.1f s)\n",
-                               w, missed[w], dt);
-                        fflush(stdout);
-                    }
-
-                    if (missed[w] >= MAX_MISSED) {
-                        printf("[MAESTRO] Worker %d marcado como MUERTO (missed=%d). Reasignando tarea %d.\n",
-                               w, missed[w], assigned_task[w]);
-                        fflush(stdout);
-
-                        int tarea_caida = assigned_task[w];
-                        task_queue[ queue_tail++ ] = tarea_caida;
-
-                        assigned_task[w] = -1;
-                        alive[w]         = 0;
-                        active_workers--;
-                    }
+                    sched_release_all(&sched, &assigned[w * TASK_BATCH_MAX], &n_assigned[w]);
+                    waiting[w] = 0;
+                    alive[w] = 0;
+                    suspected[w] = 1;
+                    active_workers--;
                 }
             }
 
+            // 3) Peticiones: [cuántas tareas quiere, tareas que terminó...]
             MPI_Iprobe(MPI_ANY_SOURCE, TASK_REQUEST, MPI_COMM_WORLD, &flag, &status);
-            if (flag) {
+            while (flag) {
                 int src = status.MPI_SOURCE;
-
-                if (!alive[src]) {
-                    int dummy;
-                    MPI_Recv(&dummy, 1, MPI_INT, src,
-                             TASK_REQUEST, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                    continue;
+                int request[1 + TASK_BATCH_MAX];
+                int n_done = 0;
+                int rc_recv = MPI_Recv(request, 1 + TASK_BATCH_MAX, MPI_INT, src,
+                                       TASK_REQUEST, MPI_COMM_WORLD, &status);
+                if (rc_recv == MPI_SUCCESS) {
+                    MPI_Get_count(&status, MPI_INT, &n_done);
+                    n_done--;
                 }
+                int *done_tasks = &request[1];
 
-                int dummy;
-                int rc_recv = MPI_Recv(&dummy, 1, MPI_INT, src,
-                                       TASK_REQUEST, MPI_COMM_WORLD, &status);
-                if (rc_recv != MPI_SUCCESS) {
+                if (!alive[src] && suspected[src] && rc_recv == MPI_SUCCESS) {
+                    // Dado por muerto pero sigue vivo: su resultado vale y
+                    // vuelve a recibir tareas
+                    phi_revive(&detector[src], src, MPI_Wtime(), alive, suspected,
+                               &active_workers);
+                }
+                if (!alive[src]) {
+                    // Ya despedido o reportado caído por MPI: nada que hacer
+                } else if (rc_recv != MPI_SUCCESS) {
                     // Este worker murió justo en la petición:
-                    if (assigned_task[src] >= 0) {
-                        task_queue[queue_tail++] = assigned_task[src];
-                    }
-                    assigned_task[src] = -1;
+                    sched_release_all(&sched, &assigned[src * TASK_BATCH_MAX], &n_assigned[src]);
                     alive[src] = 0;
                     active_workers--;
-                    continue;
-
+                    io_done_for(src);
+                } else {
+                    // Las copias se descuentan según lo que el maestro le
+                    // asignó: si se lo dio por muerto, ya se liberaron
+                    for (int i = 0; i < n_done; i++) sched_complete(&sched, done_tasks[i]);
+                    for (int i = 0; i < n_assigned[src]; i++) {
+                        sched.copies[assigned[src * TASK_BATCH_MAX + i]]--;
+                    }
+                    n_assigned[src] = 0;
+                    int want = request[0];
+                    waiting[src] = want < 1 ? 1 : (want > TASK_BATCH_MAX ? TASK_BATCH_MAX : want);
                 }
+                MPI_Iprobe(MPI_ANY_SOURCE, TASK_REQUEST, MPI_COMM_WORLD, &flag, &status);
+            }
 
-                // Si hay tareas pendientes, se la asignamos:
-                if (queue_head < queue_tail) {
-                    int tarea_id = task_queue[queue_head++];
-                    assigned_task[src] = tarea_id;
+            // 4) Un worker lento cuyo lote ya terminaron otros (copias
+            //    especulativas) lo abandona en vez de definir el tiempo total
+            for (int w = 1; w < size; w++) {
+                if (!alive[w] || n_assigned[w] == 0 || cancel_sent[w]) continue;
+                int *lote = &assigned[w * TASK_BATCH_MAX];
+                int pendientes = 0;
+                for (int i = 0; i < n_assigned[w]; i++) pendientes += !sched.done[lote[i]];
+                if (pendientes == 0) {
+                    MPI_Send(lote, n_assigned[w], MPI_INT, w, TASK_CANCEL, MPI_COMM_WORLD);
+                    cancel_sent[w] = 1;
+                    printf("[MAESTRO] Lote de worker %d ya terminado por otros: TASK_CANCEL\n", w);
+                    fflush(stdout);
+                }
+            }
 
-                    int rc_send = MPI_Send(&tarea_id, 1, MPI_INT, src,
+            // 5) Respondemos a los workers en espera
+            for (int w = 1; w < size; w++) {
+                if (!waiting[w]) continue;
+
+                int especulativa;
+                int *lote = &assigned[w * TASK_BATCH_MAX];
+                int n = sched_take(&sched, omp_get_wtime(), waiting[w], lote, &especulativa);
+                if (n > 0) {
+                    waiting[w] = 0;
+                    n_assigned[w] = n;
+                    cancel_sent[w] = 0;
+                    int rc_send = MPI_Send(lote, n, MPI_INT, w,
                                            TASK_ASSIGNMENT, MPI_COMM_WORLD);
                     if (rc_send != MPI_SUCCESS) {
                         // Si falló el envío, ese worker murió justo antes de recibir:
-                        printf("[MAESTRO] Worker %d murió antes de recibir tarea %d.\n", src, tarea_id);
+                        printf("[MAESTRO] Worker %d murió antes de recibir tarea %d.\n", w, lote[0]);
                         fflush(stdout);
 
-                        assigned_task[src] = -1;
-                        task_queue[queue_tail++] = tarea_id;
-                        alive[src] = 0;
+                        sched_release_all(&sched, lote, &n_assigned[w]);
+                        alive[w] = 0;
                         active_workers--;
+                        io_done_for(w);
+                    } else if (n == 1) {
+                        printf("[MAESTRO] Asignada tarea %d a worker %d%s\n", lote[0], w,
+                               especulativa ? " (copia especulativa)" : "");
+                        fflush(stdout);
                     } else {
-                        printf("[MAESTRO] Asignada tarea %d a worker %d\n", tarea_id, src);
+                        char lista[TASK_BATCH_MAX * 12] = "";
+                        for (int i = 0, len = 0; i < n; i++) {
+                            len += snprintf(lista + len, sizeof(lista) - len, i ? ",%d" : "%d", lote[i]);
+                        }
+                        printf("[MAESTRO] Asignadas tareas %s a worker %d%s\n", lista, w,
+                               especulativa ? " (la última, copia especulativa)" : "");
                         fflush(stdout);
                     }
-                } else {
-                    // No quedan tareas pendientes; enviamos NO_MORE_TASKS
-                    int rc_send = MPI_Send(&dummy, 1, MPI_INT, src,
+                } else if (sched.remaining == 0) {
+                    // Todas las tareas terminaron; enviamos NO_MORE_TASKS
+                    int dummy = 0;
+                    int rc_send = MPI_Send(&dummy, 1, MPI_INT, w,
                                            NO_MORE_TASKS, MPI_COMM_WORLD);
-                    if (rc_send != MPI_SUCCESS) {
-                        if (assigned_task[src] >= 0) {
-                            task_queue[queue_tail++] = assigned_task[src];
-                        }
-                        assigned_task[src] = -1;
-                        alive[src] = 0;
-                    } else {
-                        assigned_task[src] = -1;
-                        alive[src] = 0;
-                        active_workers--;
-                        printf("[MAESTRO] Worker %d recibió NO_MORE_TASKS y finaliza.\n", src);
+                    waiting[w] = 0;
+                    alive[w] = 0;
+                    active_workers--;
+                    if (rc_send == MPI_SUCCESS) {
+                        printf("[MAESTRO] Worker %d recibió NO_MORE_TASKS y finaliza.\n", w);
                         fflush(stdout);
+                    } else {
+                        io_done_for(w);
                     }
+                } else {
+                    // Quedan tareas en curso ya duplicadas: los workers siguen
+                    // en espera por si alguna se reencola
+                    break;
                 }
             }
+            pthread_mutex_unlock(&sched_lock);
+            if (IO_RANKS > 0) outbox_flush(&outbox, 0);
 
-            // 7.4) Pequeño sleep para no saturar CPU
+            // Pequeño sleep para no saturar CPU
             usleep(10000);
         }
+        if (local_running) pthread_join(local_thread, NULL);
+        if (IO_RANKS > 0) {
+            // El rango de E/S del maestro lo espera como a un worker más
+            int master = 0;
+            outbox_flush(&outbox, 1);
+            MPI_Send(&master, 1, MPI_INT, io_rank_of(0), IO_DONE_TAG, MPI_COMM_WORLD);
+        }
+        pthread_mutex_destroy(&outbox.lock);
+
+        // Un worker sospechoso que sólo estaba lento quedará esperando
+        // respuesta a su próxima petición: le dejamos NO_MORE_TASKS en camino.
+        // Su rango de E/S lo sigue esperando: el worker terminará sus envíos
+        // y avisará IO_DONE él mismo. Si el envío falla, ya no existe.
+        for (int w = 1; w < size; w++) {
+            if (suspected[w]) {
+                int dummy = 0;
+                if (MPI_Send(&dummy, 1, MPI_INT, w, NO_MORE_TASKS, MPI_COMM_WORLD) != MPI_SUCCESS) {
+                    io_done_for(w);
+                }
+            }
+        }
         // Al terminar, volcamos métricas a ‘estadisticas.txt’
         double total_time = MPI_Wtime() - start_time;
-        long total_leidas = (long)width_local * height_local * total_images;
         long total_escritas = total_leidas * 6;
         long total_operaciones = total_leidas + total_escritas;
         long total_instrucciones = total_operaciones * 20;
@@ -329,22 +1013,51 @@ int main(int argc, char *argv[]) {
         fprintf(log, "Rendimiento estimado: %.3f MIPS\n", mips);
         fclose(log);
 
+        cacheTrim(&CACHE, 1);
         printf("[MAESTRO] Todos los workers terminaron; entrando en barrera final...\n");
         fflush(stdout);
         MPI_Barrier(MPI_COMM_WORLD);
 
         free(filenames_buffer);
-        free(last_heartbeat);
-        free(missed);
-        free(assigned_task);
-        free(task_queue);
+        free(detector);
+        free(assigned);
+        free(n_assigned);
         free(alive);
+        free(waiting);
+        free(suspected);
+        free(cancel_sent);
+        free(sched.queue); free(sched.done); free(sched.copies);
+        free(sched.speculated); free(sched.start);
         printf("[MAESTRO] Llamando a MPI_Finalize() y saliendo.\n");
         fflush(stdout);
         MPI_Finalize();
         return EXIT_SUCCESS;
     }
 
+    else if (rank <= IO_RANKS) {
+        // Rango de E/S: participa en los broadcasts y barreras, no procesa
+        int total_images;
+        MPI_Bcast(&total_images, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        char *filenames_buffer = malloc((size_t)(total_images > 0 ? total_images : 1) * 512);
+        if (!filenames_buffer) {
+            fprintf(stderr, "[E/S %d] Error malloc filenames_buffer\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        MPI_Bcast(filenames_buffer, total_images * 512, MPI_CHAR, 0, MPI_COMM_WORLD);
+        free(filenames_buffer);
+
+        createFolder("salidas");
+        printf("[E/S %d] Escribiendo salidas en %s:salidas/\n", rank, hostname);
+        fflush(stdout);
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        io_rank_loop(rank, size);
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        MPI_Finalize();
+        return EXIT_SUCCESS;
+    }
+
     else {
         int total_images;
         printf("[WORKER %d] Arrancando. Esperando broadcast de total_images...\n", rank);
@@ -366,9 +1079,11 @@ int main(int argc, char *argv[]) {
             free(filenames_buffer);
         }
 
-        printf("[WORKER %d] Primera imagen en lista: %s\n",
-               rank, image_files[0]);
-        fflush(stdout);
+        if (total_images > 0) {
+            printf("[WORKER %d] Primera imagen en lista: %s\n",
+                   rank, image_files[0]);
+            fflush(stdout);
+        }
 
         volatile int keep_running = 1;
         pthread_t hb_thread;
@@ -377,7 +1092,11 @@ int main(int argc, char *argv[]) {
         hb_args.master_rank = 0;
         hb_args.keep_running = &keep_running;
 
-        if (pthread_create(&hb_thread, NULL, heartbeat_thread, &hb_args) != 0) {
+        if (!heartbeats) {
+            printf("[WORKER %d] Sin heartbeats (MPI sin THREAD_MULTIPLE).\n", rank);
+            fflush(stdout);
+        } else if (pthread_create(&hb_thread, NULL, heartbeat_thread, &hb_args) != 0) {
+            heartbeats = 0;
             fprintf(stderr, "[WORKER %d] No se pudo crear hilo de heartbeat\n", rank);
             fflush(stderr);
         } else {
@@ -385,28 +1104,39 @@ int main(int argc, char *argv[]) {
             fflush(stdout);
         }
 
-        int npix;
-        {
-            FILE *tmpf2 = fopen(image_files[0], "rb");
-            if (!tmpf2) {
-                perror("[ERROR Worker] Abrir imagen inicial");
-                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-            }
-            readHeader(tmpf2);
-            fclose(tmpf2);
-            npix = width * height;
-        }
         MPI_Barrier(MPI_COMM_WORLD);
 
         printf("[WORKER %d] Entrando en bucle principal de tareas.\n", rank);
         fflush(stdout);
 
+        // Con rangos de E/S, las salidas de una imagen viajan mientras se
+        // procesa la siguiente
+        pending_outputs_t pending;
+        memset(&pending, 0, sizeof(pending));
+        int io_rank = IO_RANKS > 0 ? io_rank_of(rank) : -1;
+        pending.io_rank = io_rank;
+
+        batch_state_t batch;
+        memset(&batch, 0, sizeof(batch));
+        batch.owner = pthread_self();
+        Engine engine = { KERNEL_SIZE, ENCODER, &CACHE, NULL, NULL, FIXED_GRAY,
+                          worker_cancelled, &batch };
+        if (io_rank >= 0) {
+            engine.sink = io_sink;
+            engine.sink_arg = &pending;
+        }
+
+        // La petición de tarea es [cuántas queremos, tareas terminadas...]
+        int request[1 + TASK_BATCH_MAX];
+        int n_done = 0;
+        request[0] = 1;
+        char who[32];
+        snprintf(who, sizeof(who), "[WORKER %d]", rank);
         while (1) {
-            int dummy = 0;
             printf("[WORKER %d] Enviando petición de tarea (TASK_REQUEST)...\n", rank);
             fflush(stdout);
 
-            int rc_send = MPI_Send(&dummy, 1, MPI_INT, 0,
+            int rc_send = MPI_Send(request, 1 + n_done, MPI_INT, 0,
                                    TASK_REQUEST, MPI_COMM_WORLD);
             if (rc_send != MPI_SUCCESS) {
                 printf("[WORKER %d] El maestro no responde, rc_send=%d. Finalizando.\n", rank, rc_send);
@@ -417,10 +1147,14 @@ int main(int argc, char *argv[]) {
             printf("[WORKER %d] Esperando MPI_Recv (TASK_ASSIGNMENT o NO_MORE_TASKS)...\n", rank);
             fflush(stdout);
 
-            int task_id;
+            int *tasks = &request[1];
             MPI_Status status2;
-            int rc_recv = MPI_Recv(&task_id, 1, MPI_INT, 0,
+            int rc_recv;
+            do {
+                // Un TASK_CANCEL del lote que ya entregamos llega tarde: se ignora
+                rc_recv = MPI_Recv(tasks, TASK_BATCH_MAX, MPI_INT, 0,
                                    MPI_ANY_TAG, MPI_COMM_WORLD, &status2);
+            } while (rc_recv == MPI_SUCCESS && status2.MPI_TAG == TASK_CANCEL);
             if (rc_recv != MPI_SUCCESS) {
                 printf("[WORKER %d] No se pudo recibir respuesta del maestro. Saliendo.\n", rank);
                 fflush(stdout);
@@ -431,122 +1165,29 @@ int main(int argc, char *argv[]) {
                 fflush(stdout);
                 break;
             }
+            MPI_Get_count(&status2, MPI_INT, &n_done);
 
-            const char *filename = image_files[task_id];
-            printf("[WORKER %d] Procesando imagen %d: %s\n", rank, task_id, filename);
-            fflush(stdout);
-
-            Pixel *buf_orig    = malloc((size_t)npix * sizeof(Pixel));
-            Pixel *buf_gray    = malloc((size_t)npix * sizeof(Pixel));
-            Pixel *buf_tmp     = malloc((size_t)npix * sizeof(Pixel));
-            Pixel *buf_blur    = malloc((size_t)npix * sizeof(Pixel));
-            Pixel *buf_hmirror = malloc((size_t)npix * sizeof(Pixel));
-            Pixel *buf_vmirror = malloc((size_t)npix * sizeof(Pixel));
-            Pixel *buf_hgray   = malloc((size_t)npix * sizeof(Pixel));
-            Pixel *buf_vgray   = malloc((size_t)npix * sizeof(Pixel));
-            if (!buf_orig || !buf_gray || !buf_tmp || !buf_blur ||
-                !buf_hmirror || !buf_vmirror || !buf_hgray || !buf_vgray) {
-                fprintf(stderr, "[WORKER %d] Error malloc buffers en imagen %d\n", rank, task_id);
-                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-            }
-
-            FILE *fin = fopen(filename, "rb");
-            if (!fin) {
-                fprintf(stderr, "[WORKER %d] [ERROR] No se puede abrir %s\n", rank, filename);
-                free(buf_orig); free(buf_gray); free(buf_tmp); free(buf_blur);
-                free(buf_hmirror); free(buf_vmirror); free(buf_hgray); free(buf_vgray);
-                continue;  // devolvemos la tarea al maestro cuando detecte caída
-            }
-            for (size_t j = 0; j < (size_t)npix; j++) {
-                unsigned char rgb[3];
-                (void) fread(rgb, 1, 3, fin);
-                buf_orig[j].b = rgb[0];
-                buf_orig[j].g = rgb[1];
-                buf_orig[j].r = rgb[2];
-            }
-            fclose(fin);
-
-            // Convertir a gris
-            #pragma omp parallel for schedule(static)
-            for (size_t j = 0; j < (size_t)npix; j++) {
-                unsigned char lum = (unsigned char)(
-                    0.21f * buf_orig[j].r +
-                    0.72f * buf_orig[j].g +
-                    0.07f * buf_orig[j].b
-                );
-                buf_gray[j].r = buf_gray[j].g = buf_gray[j].b = lum;
-            }
-
-            // Espejo horizontal y vertical
-            #pragma omp parallel for collapse(2) schedule(static)
-            for (int y = 0; y < height; y++) {
-                for (int x = 0; x < width; x++) {
-                    size_t idx = (size_t)y * width + x;
-                    buf_hmirror[idx] = buf_orig[(size_t)y * width + (width - 1 - x)];
-                    buf_vmirror[idx] = buf_orig[(size_t)(height - 1 - y) * width + x];
-                }
+            const char *names[TASK_BATCH_MAX];
+            for (int i = 0; i < n_done; i++) {
+                names[i] = image_files[tasks[i]];
+                printf("[WORKER %d] Procesando imagen %d: %s\n", rank, tasks[i], names[i]);
             }
-
-            #pragma omp parallel for schedule(static)
-            for (size_t j = 0; j < (size_t)npix; j++) {
-                int y = j / width, x = j % width;
-                buf_hgray[j] = buf_gray[(size_t)y * width + (width - 1 - x)];
-                buf_vgray[j] = buf_gray[(size_t)(height - 1 - y) * width + x];
-            }
-
-            // Blur de kernel KERNEL_SIZE × KERNEL_SIZE
-            int k = KERNEL_SIZE / 2;
-            #pragma omp parallel for collapse(2) schedule(static)
-            for (int y = 0; y < height; y++) {
-                for (int x = 0; x < width; x++) {
-                    int sr=0, sg=0, sb=0, cnt=0;
-                    for (int d = -k; d <= k; d++) {
-                        int xx = x + d;
-                        if (xx >= 0 && xx < width) {
-                            Pixel *p = &buf_orig[(size_t)y * width + xx];
-                            sr += p->r; sg += p->g; sb += p->b; cnt++;
-                        }
-                    }
-                    buf_tmp[(size_t)y * width + x].r = sr / cnt;
-                    buf_tmp[(size_t)y * width + x].g = sg / cnt;
-                    buf_tmp[(size_t)y * width + x].b = sb / cnt;
-                }
-            }
-            #pragma omp parallel for collapse(2) schedule(static)
-            for (int y = 0; y < height; y++) {
-                for (int x = 0; x < width; x++) {
-                    int sr=0, sg=0, sb=0, cnt=0;
-                    for (int d = -k; d <= k; d++) {
-                        int yy = y + d;
-                        if (yy >= 0 && yy < height) {
-                            Pixel *p = &buf_tmp[(size_t)yy * width + x];
-                            sr += p->r; sg += p->g; sb += p->b; cnt++;
-                        }
-                    }
-                    buf_blur[(size_t)y * width + x].r = sr / cnt;
-                    buf_blur[(size_t)y * width + x].g = sg / cnt;
-                    buf_blur[(size_t)y * width + x].b = sb / cnt;
-                }
-            }
-
-            // Guardar resultados
-            writeBMP(task_id + 2, "gris",      buf_gray,    KERNEL_SIZE);
-            writeBMP(task_id + 2, "esp_h",     buf_hmirror, KERNEL_SIZE);
-            writeBMP(task_id + 2, "esp_v",     buf_vmirror, KERNEL_SIZE);
-            writeBMP(task_id + 2, "esp_h_gris",buf_hgray,   KERNEL_SIZE);
-            writeBMP(task_id + 2, "esp_v_gris",buf_vgray,   KERNEL_SIZE);
-            writeBMP(task_id + 2, "blur",      buf_blur,    KERNEL_SIZE);
-
-            printf("[WORKER %d] Terminó imagen %d\n", rank, task_id);
             fflush(stdout);
 
-            free(buf_orig); free(buf_gray); free(buf_tmp); free(buf_blur);
-            free(buf_hmirror); free(buf_vmirror); free(buf_hgray); free(buf_vgray);
+            // Las que fallan también cuentan como hechas: reintentar en
+            // otro worker fallaría igual. Las descartadas ya las hizo otro.
+            request[0] = run_batch(&engine, who, names, tasks, n_done, &batch);
+        }
+
+        if (io_rank >= 0) {
+            wait_pending_outputs(&pending);
+            MPI_Send(&rank, 1, MPI_INT, io_rank, IO_DONE_TAG, MPI_COMM_WORLD);
         }
+        cacheTrim(&CACHE, 1);
 
         // Finalmente, indicamos al hilo de heartbeat que termine
         keep_running = 0;
-        pthread_join(hb_thread, NULL);
+        if (heartbeats) pthread_join(hb_thread, NULL);
 
         for (int i = 0; i < total_images; i++) {
             free(image_files[i]);